@@ -0,0 +1,40 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <limits>
+#include <string_view>
+
+// Ein minimaler Rahmen für Microbenchmarks ohne weitere Abhängigkeiten.
+// measure() ruft f in mehreren Runden jeweils iterations-mal auf und gibt die
+// Zeit pro Aufruf der schnellsten Runde aus. Die schnellste Runde ist am
+// wenigsten von anderen Prozessen und Frequenzwechseln gestört.
+namespace bench {
+// Verhindert, dass der Compiler die Berechnung von value wegoptimiert
+template <typename T> inline void keep(const T& value) noexcept {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+template <typename F> double measure(std::string_view name, std::size_t iterations, F&& f) {
+    constexpr int rounds = 7;
+
+    // Aufwärmen, damit Caches und Allokator im eingeschwungenen Zustand sind
+    for (std::size_t i = 0; i < iterations / 10 + 1; ++i) {
+        f();
+    }
+
+    auto best = std::numeric_limits<double>::max();
+    for (int round = 0; round < rounds; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < iterations; ++i) {
+            f();
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count() / static_cast<double>(iterations));
+    }
+    std::printf("%-40.*s %10.1f ns/op\n", static_cast<int>(name.size()), name.data(), best);
+    return best;
+}
+} // namespace bench
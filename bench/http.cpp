@@ -0,0 +1,94 @@
+// Vergleicht das Zerlegen eines HTTP-Headers mit field_table (Offsets in den
+// Empfangspuffer, keine Allokation) mit dem früheren Ablegen der Felder in
+// einer std::unordered_map. Dazu kommt die Suche nach dem Ende des Headers,
+// einmal mit find_header_end und einmal Zeile für Zeile, wie es der frühere
+// async_read_until pro Zeile getan hat.
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "bench.h"
+#include "http.h"
+
+namespace {
+// So wurden die Felder einer Request vor field_table gespeichert
+struct map_req {
+    core::http::verb verb { core::http::verb::GET };
+    std::string url {};
+    core::http::protocol protocol { core::http::protocol::http11 };
+    std::unordered_map<std::string, std::string> fields {};
+};
+
+// Ein typischer Request eines Browsers an das Frontend
+constexpr std::string_view request = "GET /api/v1/prosumers/3f2b8c4e-91d7-4a55-b0e2-7c1d9a6f5e83 HTTP/1.1\r\n"
+                                     "Host: localhost:3000\r\n"
+                                     "Connection: keep-alive\r\n"
+                                     "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\"\r\n"
+                                     "sec-ch-ua-mobile: ?0\r\n"
+                                     "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like "
+                                     "Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+                                     "sec-ch-ua-platform: \"Linux\"\r\n"
+                                     "Accept: application/json, text/plain, */*\r\n"
+                                     "Sec-Fetch-Site: same-origin\r\n"
+                                     "Sec-Fetch-Mode: cors\r\n"
+                                     "Sec-Fetch-Dest: empty\r\n"
+                                     "Referer: http://localhost:3000/index.html\r\n"
+                                     "Accept-Encoding: gzip, deflate, br\r\n"
+                                     "Accept-Language: de-DE,de;q=0.9,en-US;q=0.8,en;q=0.7\r\n"
+                                     "If-None-Match: \"5f3a-18b2c4d1e70\"\r\n"
+                                     "\r\n";
+} // namespace
+
+int main() {
+    constexpr std::size_t iterations = 500'000;
+    namespace internal = core::http::internal;
+
+    std::string buffer { request };
+    std::printf("Header: %zu Bytes\n\n", buffer.size());
+
+    auto lines = bench::measure("Ende suchen: Zeile für Zeile", iterations, [&] {
+        std::string_view rest { buffer };
+        std::size_t end = 0;
+        for (;;) {
+            auto eol = rest.find("\r\n");
+            end += eol + 2;
+            if (eol == 0) {
+                break;
+            }
+            rest.remove_prefix(eol + 2);
+        }
+        bench::keep(end);
+    });
+    auto block = bench::measure("Ende suchen: find_header_end", iterations, [&] {
+        auto end = internal::find_header_end(buffer, 0);
+        bench::keep(end);
+    });
+
+    map_req legacy;
+    auto map = bench::measure("Zerlegen: std::unordered_map", iterations, [&] {
+        legacy.fields.clear();
+        auto ec = internal::parse_header<false>(buffer, legacy);
+        bench::keep(ec);
+        bench::keep(legacy);
+    });
+    core::http::req req;
+    auto table = bench::measure("Zerlegen: field_table", iterations, [&] {
+        auto ec = internal::parse_header<false>(buffer, req);
+        bench::keep(ec);
+        bench::keep(req);
+    });
+
+    // Auch vorher wurde linear und ohne Beachtung der Groß- und Kleinschreibung gesucht
+    bench::measure("Feld suchen: std::unordered_map", iterations, [&] {
+        auto value = internal::find_field(legacy.fields, "accept-encoding");
+        bench::keep(value);
+    });
+    bench::measure("Feld suchen: field_table", iterations, [&] {
+        auto value = req.field("accept-encoding");
+        bench::keep(value);
+    });
+
+    std::printf("\nSuche %.1fx, Zerlegen %.1fx so schnell wie vorher\n", lines / block, map / table);
+}
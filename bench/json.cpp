@@ -0,0 +1,67 @@
+// Vergleicht das Dekodieren einer Benachrichtigung mit dem Streaming-Reader
+// (json_reader.h) mit dem früheren Weg über einen nlohmann::json-Dokumentbaum
+// und mit dem Binärformat.
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "bench.h"
+#include "models.h"
+
+namespace {
+// So hat notification::decode_json() vor dem Streaming-Reader gearbeitet
+void decode_dom(std::string_view str, core::notification& n) {
+    auto doc = nlohmann::json::parse(str);
+
+    n.id = doc["id"].get<std::string>();
+    n.power = doc["power"].get<decltype(n.power)>();
+    n.pos_x = doc["pos_x"].get<decltype(n.pos_x)>();
+    n.pos_y = doc["pos_y"].get<decltype(n.pos_y)>();
+    auto subtype = doc["subtype"].get<std::uint8_t>();
+    switch (doc["type"].get<int>()) {
+    case 0:
+        n.type = static_cast<core::producer_type>(subtype);
+        break;
+    case 1:
+        n.type = static_cast<core::consumer_type>(subtype);
+        break;
+    default:
+        throw std::runtime_error { "Nicht erlaubter index für type" };
+    }
+    n.timestamp = doc["timestamp"].get<decltype(n.timestamp)>();
+}
+} // namespace
+
+int main() {
+    constexpr std::size_t iterations = 200'000;
+
+    core::notification sample {
+        .id = "3f2b8c4e-91d7-4a55-b0e2-7c1d9a6f5e83",
+        .power = 48213,
+        .pos_x = 0.4182734,
+        .pos_y = 0.7719205,
+        .type = core::producer_type::wind,
+        .timestamp = 1'700'000'000'123,
+    };
+    auto json = sample.encode(core::wire_format::json);
+    auto binary = sample.encode(core::wire_format::binary);
+    std::printf("JSON: %zu Bytes, binär: %zu Bytes\n\n", json.size(), binary.size());
+
+    core::notification n {};
+    auto dom = bench::measure("nlohmann::json (Dokumentbaum)", iterations, [&] {
+        decode_dom(json, n);
+        bench::keep(n);
+    });
+    auto stream = bench::measure("json::reader (Streaming)", iterations, [&] {
+        n.decode_json(json);
+        bench::keep(n);
+    });
+    bench::measure("Binärformat", iterations, [&] {
+        n.decode_binary(binary);
+        bench::keep(n);
+    });
+    std::printf("\nStreaming ist %.1fx so schnell wie der Dokumentbaum\n", dom / stream);
+}
@@ -4,10 +4,15 @@
 #include <array>
 #include <cassert>
 #include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <exception>
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <system_error>
@@ -22,18 +27,303 @@
 
 namespace core::http {
 
-enum class status_code : unsigned int { ok = 200, bad_request = 400, not_found = 404 };
+enum class status_code : unsigned int {
+    ok = 200,
+    partial_content = 206,
+    not_modified = 304,
+    bad_request = 400,
+    not_found = 404,
+    method_not_allowed = 405,
+    payload_too_large = 413,
+    range_not_satisfiable = 416,
+    request_header_fields_too_large = 431
+};
 
 enum class verb { GET, POST, PUT, PATCH, DELETE };
 
+constexpr std::string_view to_string(verb verb) noexcept {
+    switch (verb) {
+    case verb::GET:
+        return "GET";
+    case verb::POST:
+        return "POST";
+    case verb::PUT:
+        return "PUT";
+    case verb::PATCH:
+        return "PATCH";
+    case verb::DELETE:
+        return "DELETE";
+    }
+    return {};
+}
+
 enum class protocol { http10 = 10, http11 = 11 };
 
+namespace internal {
+    constexpr char to_lower(char c) noexcept {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    constexpr bool iequals(std::string_view a, std::string_view b) noexcept {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return to_lower(x) == to_lower(y);
+        });
+    }
+
+    // Sucht ein Header-Feld ohne Beachtung der Groß- und Kleinschreibung
+    template <typename Fields>
+    std::optional<std::string_view> find_field(const Fields& fields, std::string_view name) {
+        for (const auto& [field, value] : fields) {
+            if (iequals(field, name)) {
+                return std::string_view { value };
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Prüft, ob eine kommaseparierte Liste wie in "Connection: keep-alive, Upgrade"
+    // das Token enthält
+    constexpr bool has_token(std::string_view list, std::string_view token) noexcept {
+        while (!list.empty()) {
+            auto comma = list.find(',');
+            auto item = list.substr(0, comma);
+            while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) {
+                item.remove_prefix(1);
+            }
+            while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) {
+                item.remove_suffix(1);
+            }
+            if (iequals(item, token)) {
+                return true;
+            }
+            if (comma == list.npos) {
+                break;
+            }
+            list.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+} // namespace internal
+
+// field_table hält die Header-Felder einer empfangenen Request, ohne sie zu
+// kopieren. Gespeichert werden nur Position und Länge von Name und Wert im
+// Empfangspuffer, in einem flachen Array fester Größe. Die Felder bleiben gültig,
+// solange die Header-Bytes im Puffer liegen. Wächst der Puffer und wird dabei
+// verschoben, muss rebase() mit der neuen Adresse aufgerufen werden.
+class field_table {
+public:
+    static constexpr std::size_t capacity = 32;
+
+private:
+    struct entry {
+        std::uint32_t name_pos;
+        std::uint32_t name_len;
+        std::uint32_t value_pos;
+        std::uint32_t value_len;
+    };
+
+    std::array<entry, capacity> entries_;
+    std::size_t size_ { 0 };
+    const char* base_ { nullptr };
+
+    std::string_view view(std::uint32_t pos, std::uint32_t len) const noexcept {
+        return { base_ + pos, len };
+    }
+
+public:
+    class const_iterator {
+        const field_table* table_;
+        std::size_t i_;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<std::string_view, std::string_view>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        const_iterator(const field_table* table, std::size_t i) noexcept
+            : table_(table)
+            , i_(i) { }
+
+        value_type operator*() const noexcept {
+            return { table_->name(i_), table_->value(i_) };
+        }
+
+        const_iterator& operator++() noexcept {
+            ++i_;
+            return *this;
+        }
+
+        const_iterator operator++(int) noexcept {
+            auto copy = *this;
+            ++i_;
+            return copy;
+        }
+
+        bool operator==(const const_iterator& other) const noexcept = default;
+    };
+
+    // Setzt den Anfang des Puffers, auf den sich die Felder beziehen
+    void rebase(const char* base) noexcept {
+        base_ = base;
+    }
+
+    const char* base() const noexcept {
+        return base_;
+    }
+
+    void clear() noexcept {
+        size_ = 0;
+    }
+
+    // Fügt ein Feld hinzu. Name und Wert müssen im Puffer ab base() liegen.
+    // Gibt false zurück, falls die Tabelle voll ist.
+    bool add(std::string_view name, std::string_view value) noexcept {
+        if (size_ == capacity) {
+            return false;
+        }
+        entries_[size_++] = {
+            static_cast<std::uint32_t>(name.data() - base_),
+            static_cast<std::uint32_t>(name.size()),
+            static_cast<std::uint32_t>(value.data() - base_),
+            static_cast<std::uint32_t>(value.size()),
+        };
+        return true;
+    }
+
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    bool empty() const noexcept {
+        return size_ == 0;
+    }
+
+    std::string_view name(std::size_t i) const noexcept {
+        return view(entries_[i].name_pos, entries_[i].name_len);
+    }
+
+    std::string_view value(std::size_t i) const noexcept {
+        return view(entries_[i].value_pos, entries_[i].value_len);
+    }
+
+    // Sucht ein Feld ohne Beachtung der Groß- und Kleinschreibung. Bei mehrfach
+    // vorhandenen Feldern wird das erste geliefert.
+    std::optional<std::string_view> find(std::string_view field) const noexcept {
+        for (std::size_t i = 0; i < size_; ++i) {
+            if (entries_[i].name_len == field.size() && internal::iequals(name(i), field)) {
+                return value(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+    const_iterator begin() const noexcept {
+        return { this, 0 };
+    }
+
+    const_iterator end() const noexcept {
+        return { this, size_ };
+    }
+};
+
+// path_params hält die Pfadparameter einer Route wie :id in
+// /api/v1/prosumers/:id. Die Werte verweisen in die URL der Request.
+class path_params {
+public:
+    static constexpr std::size_t capacity = 8;
+
+private:
+    std::array<std::pair<std::string_view, std::string_view>, capacity> params_;
+    std::size_t size_ { 0 };
+
+public:
+    void clear() noexcept {
+        size_ = 0;
+    }
+
+    // Gibt false zurück, falls kein Platz mehr ist
+    bool add(std::string_view name, std::string_view value) noexcept {
+        if (size_ == capacity) {
+            return false;
+        }
+        params_[size_++] = { name, value };
+        return true;
+    }
+
+    // Entfernt die zuletzt hinzugefügten Parameter, bis nur noch size übrig sind
+    void truncate(std::size_t size) noexcept {
+        size_ = std::min(size_, size);
+    }
+
+    std::size_t size() const noexcept {
+        return size_;
+    }
+
+    std::optional<std::string_view> find(std::string_view name) const noexcept {
+        for (std::size_t i = 0; i < size_; ++i) {
+            if (params_[i].first == name) {
+                return params_[i].second;
+            }
+        }
+        return std::nullopt;
+    }
+
+    auto begin() const noexcept {
+        return params_.begin();
+    }
+
+    auto end() const noexcept {
+        return params_.begin() + size_;
+    }
+};
+
 // req repräsentiert eine HTTP-Request
 struct req {
     verb verb { verb::GET };
     std::string url { "/" };
     protocol protocol { protocol::http11 };
-    std::unordered_map<std::string, std::string> fields {};
+    field_table fields {};
+    path_params params {};
+
+    // Muster der Route, die die Request bearbeitet, z.B. /api/v1/prosumers/:id.
+    // Leer, falls keine Route gepasst hat.
+    std::string_view route {};
+
+    // Zeitpunkt, zu dem der Header vollständig empfangen war
+    std::chrono::steady_clock::time_point received {};
+
+    std::optional<std::string_view> field(std::string_view name) const {
+        return fields.find(name);
+    }
+
+    std::optional<std::string_view> param(std::string_view name) const {
+        return params.find(name);
+    }
+
+    // Die URL ohne Query-String
+    std::string_view path() const noexcept {
+        std::string_view view { url };
+        return view.substr(0, view.find('?'));
+    }
+
+    // Der Query-String ohne das führende ?, falls vorhanden
+    std::string_view query() const noexcept {
+        std::string_view view { url };
+        auto pos = view.find('?');
+        return pos == view.npos ? std::string_view {} : view.substr(pos + 1);
+    }
+
+    // Ob der Client die Verbindung nach dieser Request offen halten möchte.
+    // HTTP/1.1 hält sie standardmäßig offen, HTTP/1.0 nur auf ausdrücklichen Wunsch.
+    bool keep_alive() const {
+        auto connection = field("Connection");
+        if (protocol == protocol::http10) {
+            return connection && internal::has_token(*connection, "keep-alive");
+        }
+        return !connection || !internal::has_token(*connection, "close");
+    }
 };
 
 // res repräsentiert eine HTTP-Antwort
@@ -49,8 +339,81 @@ struct res {
     void set_content_type(std::string_view mime_type) {
         fields["Content-Type"] = mime_type;
     }
+
+    std::optional<std::string_view> field(std::string_view name) const {
+        return internal::find_field(fields, name);
+    }
+
+    // Ob das Ende des Bodys ohne Schließen der Verbindung erkennbar ist. Eine
+    // Antwort mit 304 hat nie einen Body.
+    bool has_framing() const {
+        return status_code == http::status_code::not_modified || field("Content-Length") || field("Transfer-Encoding");
+    }
 };
 
+// Ein zusammenhängender Ausschnitt aus einem Body bekannter Länge
+struct byte_range {
+    std::uint64_t first;
+    std::uint64_t length;
+};
+
+// Wertet einen Range-Header für einen Body der Länge size aus (RFC 7233,
+// Abschnitt 2.1). Unterstützt wird genau ein Bereich. Mehrere Bereiche oder
+// unverständliche Angaben liefern nullopt, der Header wird dann ignoriert und
+// der ganze Body geschickt. Liegt der Bereich hinter dem Ende des Bodys, wird
+// zusätzlich unsatisfiable gesetzt.
+inline std::optional<byte_range> parse_range(std::string_view value, std::uint64_t size, bool& unsatisfiable) {
+    unsatisfiable = false;
+    constexpr std::string_view unit { "bytes=" };
+    if (value.size() < unit.size() || !internal::iequals(value.substr(0, unit.size()), unit)) {
+        return std::nullopt;
+    }
+    value.remove_prefix(unit.size());
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+
+    auto dash = value.find('-');
+    if (dash == value.npos || value.find(',') != value.npos) {
+        return std::nullopt;
+    }
+    auto parse = [](std::string_view digits, std::uint64_t& out) {
+        auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), out);
+        return !digits.empty() && ec == std::errc {} && end == digits.data() + digits.size();
+    };
+
+    std::uint64_t first;
+    std::uint64_t last;
+    if (dash == 0) {
+        // bytes=-n: die letzten n Bytes
+        std::uint64_t suffix;
+        if (!parse(value.substr(1), suffix)) {
+            return std::nullopt;
+        }
+        if (suffix == 0 || size == 0) {
+            unsatisfiable = true;
+            return std::nullopt;
+        }
+        suffix = std::min(suffix, size);
+        return byte_range { size - suffix, suffix };
+    }
+
+    if (!parse(value.substr(0, dash), first)) {
+        return std::nullopt;
+    }
+    if (dash + 1 == value.size()) {
+        last = size - 1;
+    } else if (!parse(value.substr(dash + 1), last) || last < first) {
+        return std::nullopt;
+    }
+    if (first >= size) {
+        unsatisfiable = true;
+        return std::nullopt;
+    }
+    last = std::min(last, size - 1);
+    return byte_range { first, last - first + 1 };
+}
+
 // Hilfsfunktionen zum Senden von Requests/Responses
 namespace internal {
     constexpr std::string_view encode_verb(verb verb) noexcept {
@@ -94,10 +457,22 @@ namespace internal {
         switch (code) {
         case status_code::ok:
             return "200 OK\r\n";
+        case status_code::partial_content:
+            return "206 Partial Content\r\n";
+        case status_code::not_modified:
+            return "304 Not Modified\r\n";
         case status_code::bad_request:
             return "400 Bad Request\r\n";
         case status_code::not_found:
             return "404 Not Found\r\n";
+        case status_code::method_not_allowed:
+            return "405 Method Not Allowed\r\n";
+        case status_code::payload_too_large:
+            return "413 Payload Too Large\r\n";
+        case status_code::range_not_satisfiable:
+            return "416 Range Not Satisfiable\r\n";
+        case status_code::request_header_fields_too_large:
+            return "431 Request Header Fields Too Large\r\n";
         }
         return "501 Not Implemented";
     }
@@ -173,8 +548,9 @@ namespace internal {
                 bufs[i] = boost::asio::buffer(std::string_view { "\r\n" });
 
                 // Schließlich muss die Puffersequenz geschrieben werden
+                auto* first = bufs.get();
                 boost::asio::async_write(stream,
-                    core::internal::util::const_iterator_pair { bufs.get(), bufs.get() + num_bufs },
+                    core::internal::util::const_iterator_pair { first, first + num_bufs },
                     core::internal::util::make_owning_handler<decltype(bufs)>(
                         std::forward<decltype(completion_handler)>(completion_handler), std::move(bufs)));
             },
@@ -198,26 +574,21 @@ auto async_write_request(AsyncReadStream& stream, Request& req,
 
 // Hilfsfunktionen zum Empfangen von Requests/Responses
 namespace internal {
-    template <typename AsyncReadStream, typename DynamicBuffer,
-        typename CompletionToken = boost::asio::default_completion_token_t<typename AsyncReadStream::executor_type>>
-    auto async_read_line(AsyncReadStream& stream, DynamicBuffer& buffer,
-        CompletionToken&& token = boost::asio::default_completion_token_t<typename AsyncReadStream::executor_type> {}) {
-        return boost::asio::async_initiate<CompletionToken, void(std::error_code, std::string_view, std::size_t)>(
-            [](auto&& completion_handler, AsyncReadStream& stream, DynamicBuffer& buffer) {
-                boost::asio::async_read_until(stream, buffer, "\r\n",
-                    [completion_handler = std::forward<decltype(completion_handler)>(completion_handler), &stream,
-                        &buffer](std::error_code ec, std::size_t matching_bytes) mutable {
-                        if (ec) {
-                            completion_handler(ec, std::string_view {}, 0);
-                            return;
-                        }
-
-                        const auto& input_buf = buffer.data();
-                        std::string_view sv { static_cast<const char*>(input_buf.data()), matching_bytes - 2 };
-                        completion_handler(ec, sv, matching_bytes);
-                    });
-            },
-            token, std::ref(stream), std::ref(buffer));
+    // Maximale Größe des Header-Blocks inklusive Request- bzw. Status-Line
+    constexpr std::size_t max_header_size = 16 * 1024;
+
+    // So viele Bytes werden pro Lesevorgang höchstens angefordert
+    constexpr std::size_t read_chunk_size = 4 * 1024;
+
+    // Sucht das Ende des Header-Blocks (die Leerzeile \r\n\r\n) und liefert die
+    // Position direkt dahinter, sonst npos. Bytes vor from wurden bereits
+    // durchsucht, dort wird nur noch ein Muster gesucht, das über die Grenze
+    // hinausreicht. string_view::find sucht das erste Zeichen mit memchr, das
+    // die libc bereits vektorisiert. Eine eigene SSE2-Schleife war laut
+    // bench/http.cpp langsamer, weil jede Zeile ein \n und damit einen Treffer hat.
+    inline std::size_t find_header_end(std::string_view data, std::size_t from) noexcept {
+        auto pos = data.find("\r\n\r\n", from < 3 ? 0 : from - 3);
+        return pos == data.npos ? pos : pos + 4;
     }
 
     template <typename Response> bool parse_status_line(std::string_view line, Response& res) {
@@ -290,85 +661,141 @@ namespace internal {
         return true;
     }
 
-    template <typename Response> bool parse_field(std::string_view line, Response& res) {
-        auto seppos = line.find(": ");
-        if (seppos == line.npos) {
-            return false;
-        }
+    inline bool add_field(field_table& fields, std::string_view name, std::string_view value) {
+        return fields.add(name, value);
+    }
 
-        std::string field_key { line.data(), seppos };
-        std::string_view field_value { line.data() + seppos + 2, line.size() - (seppos + 2) };
-        res.fields[field_key] = field_value;
+    template <typename Fields> bool add_field(Fields& fields, std::string_view name, std::string_view value) {
+        fields.emplace(name, value);
         return true;
     }
 
+    template <typename ReqRes> std::error_code parse_field(std::string_view line, ReqRes& reqres) {
+        // Zwischen Name und Doppelpunkt ist kein Leerraum erlaubt, um den Wert herum schon
+        auto colon = line.find(':');
+        if (colon == line.npos || colon == 0) {
+            return make_error_code(error::malformed_field);
+        }
+        // Eine einfache Schleife, find_first_of ruft pro Zeichen memchr auf
+        auto name = line.substr(0, colon);
+        for (auto c : name) {
+            if (c == ' ' || c == '\t') {
+                return make_error_code(error::malformed_field);
+            }
+        }
+
+        auto value = line.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+            value.remove_suffix(1);
+        }
+
+        if (!add_field(reqres.fields, name, value)) {
+            return make_error_code(error::too_many_fields);
+        }
+        return {};
+    }
+
+    // Zerlegt einen vollständigen Header-Block, der mit der Leerzeile endet. Die
+    // Felder einer Request verweisen danach direkt in block.
+    template <bool IsResponse, typename ReqRes> std::error_code parse_header(std::string_view block, ReqRes& reqres) {
+        auto eol = block.find("\r\n");
+
+        bool success;
+        // Request- bzw. Status-Line parsen
+        if constexpr (IsResponse) {
+            success = parse_status_line(block.substr(0, eol), reqres);
+        } else {
+            success = parse_request_line(block.substr(0, eol), reqres);
+        }
+        if (!success) {
+            return make_error_code(IsResponse ? error::malformed_response : error::malformed_request);
+        }
+
+        if constexpr (std::is_same_v<decltype(reqres.fields), field_table>) {
+            reqres.fields.clear();
+            reqres.fields.rebase(block.data());
+        }
+
+        // Anschließend die Header-Zeilen bis zur Leerzeile
+        for (;;) {
+            block.remove_prefix(eol + 2);
+            eol = block.find("\r\n");
+            if (eol == 0) {
+                return {};
+            }
+            if (auto ec = parse_field(block.substr(0, eol), reqres)) {
+                return ec;
+            }
+        }
+    }
+
+    // Liest den Header-Block in einem Stück in den Puffer. Statt Zeile für Zeile
+    // wird so lange gelesen, bis die Leerzeile im Puffer liegt, und der Block
+    // dann in einem Durchgang zerlegt. Der Puffer muss zusammenhängend sein (z.B.
+    // dynamic_string_buffer) und wird nicht konsumiert, die Header-Bytes bleiben
+    // für die Felder der Request erhalten. Der Handler bekommt die Größe des
+    // Header-Blocks.
     template <bool IsResponse> class async_reqres_reader {
     public:
         template <typename AsyncReadStream, typename DynamicBuffer, typename ReqRes, typename CompletionHandler>
         static inline void init(
             AsyncReadStream& stream, DynamicBuffer& buffer, ReqRes& reqres, CompletionHandler&& handler) {
-            async_read_line(stream, buffer,
-                [&stream, &buffer, &reqres, handler = std::forward<CompletionHandler>(handler)](
-                    std::error_code ec, std::string_view line, std::size_t matching_bytes) mutable {
-                    if (ec) {
-                        handler(ec);
-                        return;
-                    }
-
-                    bool success;
-                    // Request- bzw. Status-Line parsen
-                    if constexpr (IsResponse) {
-                        success = parse_status_line(line, reqres);
-                    } else {
-                        success = parse_request_line(line, reqres);
-                    }
-
-                    buffer.consume(matching_bytes);
-
-                    if (!success) {
-                        handler(make_error_code(IsResponse ? error::malformed_response : error::malformed_request));
-                        return;
-                    }
-
-                    // Anschließend mit dem Lesen der Header-Zeilen fortfahren
-                    read_header_line(stream, buffer, reqres, std::move(handler));
-                });
+            // Liegt der Header bereits vollständig im Puffer (Pipelining), darf der
+            // Handler nicht innerhalb der einleitenden Funktion aufgerufen werden.
+            read(stream, buffer, reqres, 0, std::forward<CompletionHandler>(handler), true);
         }
 
     private:
         template <typename AsyncReadStream, typename DynamicBuffer, typename ReqRes, typename CompletionHandler>
-        static inline void read_header_line(
-            AsyncReadStream& stream, DynamicBuffer& buffer, ReqRes& reqres, CompletionHandler&& handler) {
-            async_read_line(stream, buffer,
-                [&stream, &buffer, &reqres, handler = std::forward<CompletionHandler>(handler)](
-                    std::error_code ec, std::string_view line, std::size_t matching_bytes) mutable {
-                    if (ec) {
-                        handler(ec);
-                        return;
-                    }
-
-                    if (line.empty()) {
-                        buffer.consume(matching_bytes);
-                        handler(ec);
-                        return;
-                    }
-
-                    auto success = parse_field(line, reqres);
-                    if (!success) {
-                        handler(make_error_code(error::malformed_field));
-                        return;
-                    }
-
-                    buffer.consume(matching_bytes);
-                    read_header_line(stream, buffer, reqres, std::move(handler));
-                });
+        static inline void read(AsyncReadStream& stream, DynamicBuffer& buffer, ReqRes& reqres, std::size_t scanned,
+            CompletionHandler&& handler, bool initiating) {
+            auto data = buffer.data();
+            std::string_view text { static_cast<const char*>(data.data()), data.size() };
+
+            std::error_code ec;
+            std::size_t header_size = 0;
+            if (auto end = find_header_end(text, scanned); end != text.npos) {
+                ec = parse_header<IsResponse>(text.substr(0, end), reqres);
+                header_size = end;
+            } else if (text.size() >= max_header_size) {
+                ec = make_error_code(error::header_too_large);
+            } else {
+                auto bufs = buffer.prepare(std::min(read_chunk_size, max_header_size - text.size()));
+                stream.async_read_some(bufs,
+                    [&stream, &buffer, &reqres, scanned = text.size(),
+                        handler = std::forward<CompletionHandler>(handler)](
+                        std::error_code ec, std::size_t bytes_transferred) mutable {
+                        if (ec) {
+                            handler(ec, 0);
+                            return;
+                        }
+                        buffer.commit(bytes_transferred);
+                        read(stream, buffer, reqres, scanned, std::move(handler), false);
+                    });
+                return;
+            }
+
+            if (ec) {
+                header_size = 0;
+            }
+            if (initiating) {
+                boost::asio::post(stream.get_executor(),
+                    [handler = std::forward<CompletionHandler>(handler), ec, header_size]() mutable {
+                        handler(ec, header_size);
+                    });
+            } else {
+                handler(ec, header_size);
+            }
         }
     };
 
     template <typename AsyncReadStream, typename DynamicBuffer, bool IsResponse, typename ReqRes,
         typename CompletionToken = boost::asio::default_completion_token_t<typename AsyncReadStream::executor_type>>
     auto async_read_reqres(AsyncReadStream& stream, DynamicBuffer& buffer, ReqRes& reqres, CompletionToken&& token) {
-        return boost::asio::async_initiate<CompletionToken, void(std::error_code)>(
+        return boost::asio::async_initiate<CompletionToken, void(std::error_code, std::size_t)>(
             [](auto&& completion_handler, AsyncReadStream& stream, DynamicBuffer& buffer, ReqRes& reqres) {
                 async_reqres_reader<IsResponse>::init(
                     stream, buffer, reqres, std::forward<decltype(completion_handler)>(completion_handler));
@@ -8,7 +8,11 @@ enum class error {
 
     malformed_request = 1,
     malformed_response,
-    malformed_field
+    malformed_field,
+    header_too_large,
+    too_many_fields,
+    malformed_body,
+    body_too_large
 };
 
 namespace internal {
@@ -26,6 +30,10 @@ public:
             case error::malformed_request: return "malformed request";
             case error::malformed_response: return "malformed response";
             case error::malformed_field: return "malformed field";
+            case error::header_too_large: return "header too large";
+            case error::too_many_fields: return "too many fields";
+            case error::malformed_body: return "malformed body";
+            case error::body_too_large: return "body too large";
         default:
             return "core.http error";
         }
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace core::internal::json {
+
+// reader ist ein minimaler, vorwärtsgerichteter JSON-Leser für Nachrichten mit
+// festem Schema. Statt wie nlohmann::json::parse erst einen vollständigen
+// Dokumentbaum aufzubauen, liest der Aufrufer Token für Token direkt in seine
+// Zielvariablen. Dabei wird nichts auf dem Heap allokiert, außer ein gelesener
+// String wächst über die Kapazität seines Ziels hinaus.
+//
+// Fehler werden als std::runtime_error mit der Position im Eingabetext
+// gemeldet.
+class reader {
+    std::string_view input_;
+    std::size_t pos_ { 0 };
+
+    [[noreturn]] void fail(std::string_view what) const {
+        std::string message { "JSON-Fehler an Position " };
+        message += std::to_string(pos_);
+        message += ": ";
+        message += what;
+        throw std::runtime_error { message };
+    }
+
+    static constexpr bool is_whitespace(char c) noexcept {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static constexpr bool is_digit(char c) noexcept {
+        return c >= '0' && c <= '9';
+    }
+
+    // Prüft die JSON-Grammatik einer Zahl und gibt das Token zurück
+    std::string_view scan_number() {
+        auto begin = pos_;
+        if (pos_ < input_.size() && input_[pos_] == '-') {
+            ++pos_;
+        }
+        if (pos_ >= input_.size() || !is_digit(input_[pos_])) {
+            fail("Zahl erwartet");
+        }
+        if (input_[pos_] == '0') {
+            ++pos_;
+        } else {
+            while (pos_ < input_.size() && is_digit(input_[pos_])) {
+                ++pos_;
+            }
+        }
+        if (pos_ < input_.size() && input_[pos_] == '.') {
+            ++pos_;
+            if (pos_ >= input_.size() || !is_digit(input_[pos_])) {
+                fail("Ziffer nach dem Dezimalpunkt erwartet");
+            }
+            while (pos_ < input_.size() && is_digit(input_[pos_])) {
+                ++pos_;
+            }
+        }
+        if (pos_ < input_.size() && (input_[pos_] == 'e' || input_[pos_] == 'E')) {
+            ++pos_;
+            if (pos_ < input_.size() && (input_[pos_] == '+' || input_[pos_] == '-')) {
+                ++pos_;
+            }
+            if (pos_ >= input_.size() || !is_digit(input_[pos_])) {
+                fail("Ziffer im Exponenten erwartet");
+            }
+            while (pos_ < input_.size() && is_digit(input_[pos_])) {
+                ++pos_;
+            }
+        }
+        return input_.substr(begin, pos_ - begin);
+    }
+
+    static void append_utf8(std::string& out, std::uint32_t code_point) {
+        if (code_point < 0x80) {
+            out += static_cast<char>(code_point);
+        } else if (code_point < 0x800) {
+            out += static_cast<char>(0xC0 | (code_point >> 6));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        } else if (code_point < 0x10000) {
+            out += static_cast<char>(0xE0 | (code_point >> 12));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code_point >> 18));
+            out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+    }
+
+    std::uint32_t read_hex4() {
+        if (input_.size() - pos_ < 4) {
+            fail("Unvollständige \\u-Escape-Sequenz");
+        }
+        std::uint32_t value;
+        auto [ptr, ec] = std::from_chars(input_.data() + pos_, input_.data() + pos_ + 4, value, 16);
+        if (ec != std::errc {} || ptr != input_.data() + pos_ + 4) {
+            fail("Ungültige \\u-Escape-Sequenz");
+        }
+        pos_ += 4;
+        return value;
+    }
+
+public:
+    explicit reader(std::string_view input) noexcept
+        : input_(input) { }
+
+    std::size_t position() const noexcept {
+        return pos_;
+    }
+
+    void skip_whitespace() noexcept {
+        while (pos_ < input_.size() && is_whitespace(input_[pos_])) {
+            ++pos_;
+        }
+    }
+
+    // Überspringt Leerraum und konsumiert das Zeichen c, falls es als nächstes kommt
+    bool consume(char c) noexcept {
+        skip_whitespace();
+        if (pos_ < input_.size() && input_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!consume(c)) {
+            fail(std::string { "'" } + c + "' erwartet");
+        }
+    }
+
+    // Nach dem Ende des Dokuments darf nur noch Leerraum folgen
+    void expect_end() {
+        skip_whitespace();
+        if (pos_ != input_.size()) {
+            fail("Unerwartete Zeichen nach dem Ende des Dokuments");
+        }
+    }
+
+    // Liest einen Objektschlüssel inklusive des folgenden Doppelpunkts. Da die
+    // Schlüssel des Schemas bekannt sind, werden Escape-Sequenzen in Schlüsseln
+    // nicht unterstützt und der Schlüssel kann ohne Kopie zurückgegeben werden.
+    std::string_view read_key() {
+        expect('"');
+        auto begin = pos_;
+        while (pos_ < input_.size() && input_[pos_] != '"') {
+            if (input_[pos_] == '\\') {
+                fail("Escape-Sequenzen in Schlüsseln werden nicht unterstützt");
+            }
+            ++pos_;
+        }
+        if (pos_ >= input_.size()) {
+            fail("Unterminierter Schlüssel");
+        }
+        auto key = input_.substr(begin, pos_ - begin);
+        ++pos_;
+        expect(':');
+        return key;
+    }
+
+    void read_string(std::string& out) {
+        expect('"');
+        out.clear();
+        for (;;) {
+            // Zusammenhängende Abschnitte ohne Escape-Sequenzen am Stück kopieren
+            auto begin = pos_;
+            while (pos_ < input_.size() && input_[pos_] != '"' && input_[pos_] != '\\') {
+                if (static_cast<unsigned char>(input_[pos_]) < 0x20) {
+                    fail("Steuerzeichen in String");
+                }
+                ++pos_;
+            }
+            out.append(input_.data() + begin, pos_ - begin);
+
+            if (pos_ >= input_.size()) {
+                fail("Unterminierter String");
+            }
+            if (input_[pos_++] == '"') {
+                return;
+            }
+
+            if (pos_ >= input_.size()) {
+                fail("Unvollständige Escape-Sequenz");
+            }
+            switch (input_[pos_++]) {
+            case '"':
+                out += '"';
+                break;
+            case '\\':
+                out += '\\';
+                break;
+            case '/':
+                out += '/';
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'u': {
+                auto code_point = read_hex4();
+                if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+                    // Surrogatpaar
+                    if (input_.substr(pos_, 2) != "\\u") {
+                        fail("Unvollständiges Surrogatpaar");
+                    }
+                    pos_ += 2;
+                    auto low = read_hex4();
+                    if (low < 0xDC00 || low > 0xDFFF) {
+                        fail("Ungültiges Surrogatpaar");
+                    }
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+                    fail("Ungültiges Surrogatpaar");
+                }
+                append_utf8(out, code_point);
+                break;
+            }
+            default:
+                --pos_;
+                fail("Ungültige Escape-Sequenz");
+            }
+        }
+    }
+
+    template <typename Integer> Integer read_integer() {
+        skip_whitespace();
+        auto begin = pos_;
+        auto token = scan_number();
+        Integer value;
+        auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value, 10);
+        if (ec == std::errc::result_out_of_range) {
+            pos_ = begin;
+            fail("Zahl außerhalb des Wertebereichs");
+        }
+        if (ec != std::errc {} || ptr != token.data() + token.size()) {
+            pos_ = begin;
+            fail("Ganzzahl erwartet");
+        }
+        return value;
+    }
+
+    double read_double() {
+        skip_whitespace();
+        auto begin = pos_;
+        auto token = scan_number();
+
+        // std::from_chars für Gleitkommazahlen steht nicht überall zur Verfügung,
+        // deshalb wird das bereits geprüfte Token auf dem Stack nullterminiert und
+        // mit strtod gelesen.
+        char buf[64];
+        if (token.size() >= sizeof(buf)) {
+            pos_ = begin;
+            fail("Zahl zu lang");
+        }
+        std::copy(token.begin(), token.end(), buf);
+        buf[token.size()] = '\0';
+        return std::strtod(buf, nullptr);
+    }
+};
+
+}
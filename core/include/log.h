@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace core::log {
+
+enum class level : std::uint8_t { debug, info, warning, error };
+
+constexpr std::string_view to_string(level l) noexcept {
+    switch (l) {
+    case level::debug:
+        return "debug";
+    case level::info:
+        return "info";
+    case level::warning:
+        return "warning";
+    case level::error:
+        return "error";
+    }
+    return "unknown";
+}
+
+inline std::optional<level> parse_level(std::string_view name) noexcept {
+    for (auto l : { level::debug, level::info, level::warning, level::error }) {
+        if (name == to_string(l)) {
+            return l;
+        }
+    }
+    return std::nullopt;
+}
+
+// Ein Logeintrag fester Größe. Der Text ist bereits als key=value-Paare
+// (logfmt) formatiert, Zeitstempel und Level setzt erst der Writer-Thread davor.
+struct record {
+    static constexpr std::size_t capacity = 240;
+
+    std::chrono::system_clock::time_point time;
+    log::level severity;
+    std::uint16_t size { 0 };
+    std::array<char, capacity> text;
+};
+
+namespace internal {
+    // ring ist eine beschränkte Warteschlange für viele Erzeuger und einen
+    // Verbraucher ohne Locks (nach Dmitry Vyukov). Jeder Slot trägt eine
+    // Sequenznummer, an der Erzeuger und Verbraucher erkennen, ob er frei bzw.
+    // gefüllt ist. Ist der Ring voll, schlägt try_push fehl, statt zu warten.
+    template <std::size_t Capacity> class ring {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity muss eine Zweierpotenz sein");
+
+        struct slot {
+            std::atomic<std::size_t> sequence;
+            record value;
+        };
+
+        std::unique_ptr<slot[]> slots_ { new slot[Capacity] };
+        alignas(64) std::atomic<std::size_t> head_ { 0 };
+        alignas(64) std::size_t tail_ { 0 };
+
+    public:
+        ring() {
+            for (std::size_t i = 0; i < Capacity; ++i) {
+                slots_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        bool try_push(const record& r) noexcept {
+            auto pos = head_.load(std::memory_order_relaxed);
+            for (;;) {
+                auto& s = slots_[pos & (Capacity - 1)];
+                auto seq = s.sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+                if (diff == 0) {
+                    if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        s.value = r;
+                        s.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = head_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Ruft f(record) für den ältesten Eintrag auf und gibt den Slot frei.
+        // Darf nur vom Verbraucher aufgerufen werden.
+        template <typename F> bool try_consume(F&& f) {
+            auto& s = slots_[tail_ & (Capacity - 1)];
+            if (s.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+                return false;
+            }
+            f(s.value);
+            s.sequence.store(tail_ + Capacity, std::memory_order_release);
+            ++tail_;
+            return true;
+        }
+    };
+
+    // Der Writer-Thread holt die Einträge aus dem Ring und schreibt sie
+    // stapelweise mit einem einzigen fwrite pro Stapel
+    class logger {
+        static constexpr std::size_t ring_size = 4096;
+        static constexpr std::size_t batch_size = 256;
+
+        ring<ring_size> ring_ {};
+        std::atomic<std::uint64_t> dropped_ { 0 };
+        std::atomic<bool> stop_ { false };
+        std::FILE* out_ { stdout };
+        std::thread writer_;
+
+        static void append_time(std::string& out, std::chrono::system_clock::time_point time) {
+            auto since_epoch = time.time_since_epoch();
+            auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+            auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(since_epoch - seconds).count();
+            std::time_t t = seconds.count();
+            std::tm tm;
+            gmtime_r(&t, &tm);
+
+            char buf[32];
+            auto len = std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+            len += static_cast<std::size_t>(std::snprintf(buf + len, sizeof(buf) - len, ".%03dZ", static_cast<int>(millis)));
+            out.append(buf, len);
+        }
+
+        // Leert den Ring. Liefert die Zahl der geschriebenen Einträge.
+        std::size_t drain(std::string& buffer) {
+            std::size_t written = 0;
+            for (;;) {
+                buffer.clear();
+                std::size_t n = 0;
+                while (n < batch_size && ring_.try_consume([&](const record& r) {
+                    buffer += "ts=";
+                    append_time(buffer, r.time);
+                    buffer += " level=";
+                    buffer += to_string(r.severity);
+                    buffer += ' ';
+                    buffer.append(r.text.data(), r.size);
+                    buffer += '\n';
+                })) {
+                    ++n;
+                }
+
+                if (auto dropped = dropped_.exchange(0, std::memory_order_relaxed)) {
+                    buffer += "ts=";
+                    append_time(buffer, std::chrono::system_clock::now());
+                    buffer += " level=warning msg=\"Logeinträge verworfen\" count=";
+                    buffer += std::to_string(dropped);
+                    buffer += '\n';
+                }
+                if (buffer.empty()) {
+                    return written;
+                }
+                std::fwrite(buffer.data(), 1, buffer.size(), out_);
+                std::fflush(out_);
+                written += n;
+            }
+        }
+
+        void run() {
+            std::string buffer;
+            buffer.reserve(batch_size * 128);
+            auto idle = std::chrono::microseconds { 100 };
+            while (!stop_.load(std::memory_order_acquire)) {
+                if (drain(buffer) > 0) {
+                    idle = std::chrono::microseconds { 100 };
+                    continue;
+                }
+                // Ohne Einträge wartet der Thread immer länger, höchstens 10 ms
+                std::this_thread::sleep_for(idle);
+                idle = std::min<std::chrono::microseconds>(idle * 2, std::chrono::milliseconds { 10 });
+            }
+            drain(buffer);
+        }
+
+    public:
+        std::atomic<level> min_level { level::info };
+        std::atomic<unsigned int> sample_rate { 1 };
+
+        logger()
+            : writer_([this] { run(); }) { }
+
+        ~logger() {
+            stop_.store(true, std::memory_order_release);
+            writer_.join();
+        }
+
+        void submit(const record& r) noexcept {
+            if (!ring_.try_push(r)) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        static logger& instance() {
+            static logger l;
+            return l;
+        }
+    };
+} // namespace internal
+
+// Einträge unterhalb von l werden verworfen, bevor sie formatiert werden
+inline void set_level(level l) {
+    internal::logger::instance().min_level.store(l, std::memory_order_relaxed);
+}
+
+inline bool enabled(level l) {
+    return l >= internal::logger::instance().min_level.load(std::memory_order_relaxed);
+}
+
+// Mit einer Rate von n wird nur jeder n-te Aufruf von sample() true, bei 0 keiner
+inline void set_sample_rate(unsigned int n) {
+    internal::logger::instance().sample_rate.store(n, std::memory_order_relaxed);
+}
+
+inline bool sample() {
+    auto rate = internal::logger::instance().sample_rate.load(std::memory_order_relaxed);
+    if (rate <= 1) {
+        return rate == 1;
+    }
+    thread_local unsigned int counter = 0;
+    return ++counter % rate == 0;
+}
+
+// entry baut einen Logeintrag auf dem Stack zusammen und reiht ihn am Ende des
+// Ausdrucks in den Ring ein. Weder das Formatieren noch das Einreihen allokiert,
+// sperrt oder schreibt auf stdout. Ist der Ring voll, geht der Eintrag verloren
+// und wird nur gezählt. Zu lange Einträge werden abgeschnitten.
+//
+//     core::log::entry { core::log::level::info, "Prosumer abgemeldet" }.field("id", id);
+class entry {
+    record record_;
+    bool enabled_;
+
+    void append(std::string_view s) noexcept {
+        auto n = std::min<std::size_t>(s.size(), record::capacity - record_.size);
+        std::copy_n(s.data(), n, record_.text.data() + record_.size);
+        record_.size += static_cast<std::uint16_t>(n);
+    }
+
+    void append_value(std::string_view value) noexcept {
+        if (!value.empty() && value.find_first_of(" \"=\\\t\r\n") == value.npos) {
+            append(value);
+            return;
+        }
+        std::array<char, record::capacity> quoted;
+        std::size_t n = 0;
+        quoted[n++] = '"';
+        for (auto c : value) {
+            if (n + 3 > quoted.size()) {
+                break;
+            }
+            if (c == '"' || c == '\\') {
+                quoted[n++] = '\\';
+            } else if (c == '\n' || c == '\r' || c == '\t') {
+                c = ' ';
+            }
+            quoted[n++] = c;
+        }
+        quoted[n++] = '"';
+        append({ quoted.data(), n });
+    }
+
+public:
+    entry(level l, std::string_view message)
+        : enabled_(enabled(l)) {
+        if (!enabled_) {
+            return;
+        }
+        record_.time = std::chrono::system_clock::now();
+        record_.severity = l;
+        append("msg=");
+        append_value(message);
+    }
+
+    entry(const entry&) = delete;
+    entry& operator=(const entry&) = delete;
+
+    ~entry() {
+        if (enabled_) {
+            internal::logger::instance().submit(record_);
+        }
+    }
+
+    entry& field(std::string_view key, std::string_view value) noexcept {
+        if (enabled_) {
+            append(" ");
+            append(key);
+            append("=");
+            append_value(value);
+        }
+        return *this;
+    }
+
+    entry& field(std::string_view key, const char* value) noexcept {
+        return field(key, std::string_view { value });
+    }
+
+    template <std::integral T> entry& field(std::string_view key, T value) noexcept {
+        if (enabled_) {
+            char buf[24];
+            auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+            append(" ");
+            append(key);
+            append("=");
+            append({ buf, static_cast<std::size_t>(end - buf) });
+        }
+        return *this;
+    }
+};
+
+inline entry debug(std::string_view message) {
+    return { level::debug, message };
+}
+
+inline entry info(std::string_view message) {
+    return { level::info, message };
+}
+
+inline entry warning(std::string_view message) {
+    return { level::warning, message };
+}
+
+inline entry error(std::string_view message) {
+    return { level::error, message };
+}
+
+} // namespace core::log
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace core::metrics {
+
+namespace internal {
+    // Messwerte werden auf shard_count Zellen verteilt, jeder Thread schreibt in
+    // seine eigene. Solange es nicht mehr Threads als Zellen gibt, teilt sich
+    // kein Thread eine Cache-Line mit einem anderen, und das Erhöhen ist ein
+    // unbestrittenes atomares Addieren ohne Lock.
+    constexpr std::size_t shard_count = 16;
+
+    inline std::size_t thread_shard() noexcept {
+        static std::atomic<std::size_t> next { 0 };
+        thread_local std::size_t shard = next.fetch_add(1, std::memory_order_relaxed) % shard_count;
+        return shard;
+    }
+
+    struct alignas(64) cell {
+        std::atomic<std::uint64_t> value { 0 };
+    };
+
+    // Kürzeste Darstellung, die beim Zurücklesen denselben Wert ergibt
+    inline void append_number(std::string& out, double value) {
+        char buf[32];
+        auto len = std::snprintf(buf, sizeof(buf), "%.15g", value);
+        if (std::strtod(buf, nullptr) != value) {
+            len = std::snprintf(buf, sizeof(buf), "%.17g", value);
+        }
+        out.append(buf, static_cast<std::size_t>(len));
+    }
+
+    inline void append_number(std::string& out, std::uint64_t value) {
+        out += std::to_string(value);
+    }
+} // namespace internal
+
+// Schreibt die Kopfzeilen einer Metrik im Textformat von Prometheus
+inline void write_header(std::string& out, std::string_view name, std::string_view help, std::string_view type) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+// Schreibt einen Messwert. labels ist bereits formatiert, z.B. route="/",code="2xx".
+template <typename T>
+void write_sample(std::string& out, std::string_view name, std::string_view labels, T value) {
+    out += name;
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    internal::append_number(out, value);
+    out += '\n';
+}
+
+// Ein monoton steigender Zähler
+class counter {
+    std::array<internal::cell, internal::shard_count> cells_ {};
+
+public:
+    void add(std::uint64_t n = 1) noexcept {
+        cells_[internal::thread_shard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t value() const noexcept {
+        std::uint64_t sum = 0;
+        for (const auto& c : cells_) {
+            sum += c.value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+};
+
+// Ein Wert, der steigen und fallen kann, z.B. die Länge einer Warteschlange
+class gauge {
+    std::atomic<std::int64_t> value_ { 0 };
+
+public:
+    void set(std::int64_t value) noexcept {
+        value_.store(value, std::memory_order_relaxed);
+    }
+
+    void add(std::int64_t n) noexcept {
+        value_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::int64_t value() const noexcept {
+        return value_.load(std::memory_order_relaxed);
+    }
+};
+
+// histogram zählt Dauern in Buckets mit log-linearer Einteilung (wie bei
+// HdrHistogram): Jede Zweierpotenz an Mikrosekunden ist in zwei Buckets
+// geteilt, die Grenzen sind also 1, 2, 3, 4, 6, 8, 12, 16, ... µs. Der relative
+// Fehler bleibt damit über den ganzen Bereich von 1 µs bis gut zwei Minuten
+// unter 50 %, bei nur 54 Buckets. Größere Werte landen im Bucket +Inf.
+class histogram {
+public:
+    static constexpr std::size_t max_exponent = 26;
+    static constexpr std::size_t bucket_count = 2 * max_exponent + 2;
+
+    // Obere Grenze des Buckets i in Mikrosekunden
+    static constexpr std::uint64_t upper_bound(std::size_t i) noexcept {
+        if (i < 2) {
+            return i + 1;
+        }
+        auto e = i / 2;
+        return i % 2 == 0 ? std::uint64_t { 3 } << (e - 1) : std::uint64_t { 1 } << (e + 1);
+    }
+
+    // Index des kleinsten Buckets, dessen obere Grenze micros nicht unterschreitet
+    static constexpr std::size_t bucket_of(std::uint64_t micros) noexcept {
+        if (micros <= 2) {
+            return micros == 0 ? 0 : micros - 1;
+        }
+        // 2^e < micros <= 2^(e+1)
+        auto e = static_cast<std::size_t>(std::bit_width(micros - 1) - 1);
+        if (e > max_exponent) {
+            return bucket_count;
+        }
+        return micros <= (std::uint64_t { 3 } << (e - 1)) ? 2 * e : 2 * e + 1;
+    }
+
+private:
+    struct alignas(64) shard {
+        std::array<std::atomic<std::uint64_t>, bucket_count + 1> counts {};
+        std::atomic<std::uint64_t> sum { 0 };
+    };
+
+    std::array<shard, internal::shard_count> shards_ {};
+
+public:
+    void observe(std::chrono::steady_clock::duration d) noexcept {
+        auto micros = static_cast<std::uint64_t>(
+            std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count(), 0));
+        auto& s = shards_[internal::thread_shard()];
+        s.counts[bucket_of(micros)].fetch_add(1, std::memory_order_relaxed);
+        s.sum.fetch_add(micros, std::memory_order_relaxed);
+    }
+
+    // Schreibt die kumulierten Buckets, die Summe in Sekunden und die Anzahl
+    void write(std::string& out, std::string_view name, std::string_view labels) const {
+        std::array<std::uint64_t, bucket_count + 1> counts {};
+        std::uint64_t sum = 0;
+        for (const auto& s : shards_) {
+            for (std::size_t i = 0; i < counts.size(); ++i) {
+                counts[i] += s.counts[i].load(std::memory_order_relaxed);
+            }
+            sum += s.sum.load(std::memory_order_relaxed);
+        }
+
+        std::string bucket_name { name };
+        bucket_name += "_bucket";
+        std::string bucket_labels { labels };
+        if (!bucket_labels.empty()) {
+            bucket_labels += ',';
+        }
+        auto prefix = bucket_labels.size();
+
+        std::uint64_t cumulative = 0;
+        for (std::size_t i = 0; i <= bucket_count; ++i) {
+            cumulative += counts[i];
+            bucket_labels.resize(prefix);
+            bucket_labels += "le=\"";
+            if (i == bucket_count) {
+                bucket_labels += "+Inf";
+            } else {
+                internal::append_number(bucket_labels, static_cast<double>(upper_bound(i)) / 1e6);
+            }
+            bucket_labels += '"';
+            write_sample(out, bucket_name, bucket_labels, cumulative);
+        }
+        write_sample(out, std::string { name } + "_sum", labels, static_cast<double>(sum) / 1e6);
+        write_sample(out, std::string { name } + "_count", labels, cumulative);
+    }
+};
+
+// registry kennt alle Metriken und schreibt sie im Textformat von Prometheus.
+// Metriken werden beim Start angelegt und leben so lange wie die registry, die
+// Referenzen darauf bleiben gültig. Nur das Anlegen und das Ausgeben sperren,
+// das Messen selbst nie.
+class registry {
+    enum class kind { counter, gauge, histogram };
+
+    struct family {
+        std::string name;
+        std::string help;
+        kind kind;
+        std::vector<std::pair<std::string, const void*>> members {};
+    };
+
+    mutable std::mutex mutex_ {};
+    std::vector<family> families_ {};
+    std::deque<counter> counters_ {};
+    std::deque<gauge> gauges_ {};
+    std::deque<histogram> histograms_ {};
+
+    // Alle Metriken eines Namens müssen dieselbe Art und Beschreibung haben,
+    // sonst wirft family_of std::invalid_argument
+    family& family_of(std::string_view name, std::string_view help, kind k) {
+        for (auto& f : families_) {
+            if (f.name == name) {
+                if (f.kind != k || f.help != help) {
+                    throw std::invalid_argument { "Metrik " + f.name
+                        + " ist bereits mit anderer Art oder Beschreibung registriert" };
+                }
+                return f;
+            }
+        }
+        return families_.emplace_back(family { std::string { name }, std::string { help }, k });
+    }
+
+public:
+    counter& add_counter(std::string_view name, std::string_view help, std::string_view labels = {}) {
+        std::lock_guard lock { mutex_ };
+        auto& f = family_of(name, help, kind::counter);
+        auto& c = counters_.emplace_back();
+        f.members.emplace_back(std::string { labels }, &c);
+        return c;
+    }
+
+    gauge& add_gauge(std::string_view name, std::string_view help, std::string_view labels = {}) {
+        std::lock_guard lock { mutex_ };
+        auto& f = family_of(name, help, kind::gauge);
+        auto& g = gauges_.emplace_back();
+        f.members.emplace_back(std::string { labels }, &g);
+        return g;
+    }
+
+    histogram& add_histogram(std::string_view name, std::string_view help, std::string_view labels = {}) {
+        std::lock_guard lock { mutex_ };
+        auto& f = family_of(name, help, kind::histogram);
+        auto& h = histograms_.emplace_back();
+        f.members.emplace_back(std::string { labels }, &h);
+        return h;
+    }
+
+    void write(std::string& out) const {
+        std::lock_guard lock { mutex_ };
+        for (const auto& f : families_) {
+            switch (f.kind) {
+            case kind::counter:
+                write_header(out, f.name, f.help, "counter");
+                for (const auto& [labels, m] : f.members) {
+                    write_sample(out, f.name, labels, static_cast<const counter*>(m)->value());
+                }
+                break;
+            case kind::gauge:
+                write_header(out, f.name, f.help, "gauge");
+                for (const auto& [labels, m] : f.members) {
+                    write_sample(out, f.name, labels, static_cast<double>(static_cast<const gauge*>(m)->value()));
+                }
+                break;
+            case kind::histogram:
+                write_header(out, f.name, f.help, "histogram");
+                for (const auto& [labels, m] : f.members) {
+                    static_cast<const histogram*>(m)->write(out, f.name, labels);
+                }
+                break;
+            }
+        }
+    }
+};
+
+// Maskiert einen Label-Wert für das Textformat (Backslash, Anführungszeichen, Zeilenumbruch)
+inline std::string label_value(std::string_view value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (auto c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+} // namespace core::metrics
@@ -1,11 +1,20 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
 #include <cstdint>
+#include <cstring>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <variant>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
+#include "json_reader.h"
+
 namespace core {
 enum class producer_type : std::uint8_t {
     coal,
@@ -16,6 +25,62 @@ enum class producer_type : std::uint8_t {
 };
 enum class consumer_type : std::uint8_t { personal, industrial };
 
+// Format, in dem eine Benachrichtigung über UDP übertragen wird
+enum class wire_format { json, binary };
+
+// Hilfsfunktionen für das Binärformat
+namespace internal::wire {
+    // Das erste Byte eines binär kodierten Datagramms: Die oberen vier Bit sind
+    // eine feste Kennung, die unteren vier Bit die Version des Formats. Ein
+    // JSON-Datagramm beginnt immer mit '{' oder Leerraum und kann daher nicht
+    // mit einem Binärdatagramm verwechselt werden.
+    constexpr std::uint8_t magic = 0xA0;
+    constexpr std::uint8_t magic_mask = 0xF0;
+    constexpr std::uint8_t version = 1;
+    constexpr std::uint8_t batch_version = 2;
+
+    // Größe aller Felder mit fester Länge (ohne die ID selbst)
+    constexpr std::size_t fixed_size = 1 + 1 + sizeof(std::uint64_t) + 2 * sizeof(double) + 1 + sizeof(std::int64_t);
+
+    template <typename T> void store_le(char* out, T value) noexcept {
+        static_assert(sizeof(T) == 8);
+        std::uint64_t raw;
+        std::memcpy(&raw, &value, sizeof(raw));
+        if constexpr (std::endian::native == std::endian::big) {
+            raw = __builtin_bswap64(raw);
+        }
+        std::memcpy(out, &raw, sizeof(raw));
+    }
+
+    template <typename T> T load_le(const char* in) noexcept {
+        static_assert(sizeof(T) == 8);
+        std::uint64_t raw;
+        std::memcpy(&raw, in, sizeof(raw));
+        if constexpr (std::endian::native == std::endian::big) {
+            raw = __builtin_bswap64(raw);
+        }
+        T value;
+        std::memcpy(&value, &raw, sizeof(value));
+        return value;
+    }
+
+    inline bool is_binary(std::string_view str) noexcept {
+        return !str.empty() && (static_cast<std::uint8_t>(str[0]) & magic_mask) == magic;
+    }
+
+    // Ältere Prosumer schicken den Zeitstempel in Sekunden. 10^11 Millisekunden
+    // sind der 3. März 1973, 10^11 Sekunden erst das Jahr 5138. Kleinere Werte
+    // können also nur Sekunden sein und werden umgerechnet.
+    constexpr std::int64_t seconds_limit = 100'000'000'000;
+
+    constexpr std::int64_t normalize_timestamp(std::int64_t timestamp) noexcept {
+        if (timestamp > -seconds_limit && timestamp < seconds_limit) {
+            return timestamp * 1000;
+        }
+        return timestamp;
+    }
+} // namespace internal::wire
+
 // Daten, die von den Erzeugern/Verbrauchern an die Zentrale geschickt werden
 struct notification {
     std::string id;
@@ -23,9 +88,19 @@ struct notification {
     double pos_x;
     double pos_y;
     std::variant<producer_type, consumer_type> type;
+
+    // Millisekunden seit der Unix-Epoche. Zeitstempel in Sekunden rechnet
+    // decode() beim Empfang um.
     std::int64_t timestamp;
 
     nlohmann::json to_json() const {
+        return to_json(id, power, pos_x, pos_y, type, timestamp);
+    }
+
+    // Erzeugt die JSON-Darstellung aus einzelnen Feldern, ohne dafür eine
+    // Benachrichtigung (samt Kopie der ID) anlegen zu müssen
+    static nlohmann::json to_json(std::string_view id, std::uint64_t power, double pos_x, double pos_y,
+        const std::variant<producer_type, consumer_type>& type, std::int64_t timestamp) {
         return nlohmann::json {
             {"id", id},
             {"power", power},
@@ -37,29 +112,344 @@ struct notification {
         };
     }
 
-    std::string encode() const {
+    std::string encode(wire_format format = wire_format::json) const {
+        if (format == wire_format::binary) {
+            return encode_binary();
+        }
         return to_json().dump();
     }
 
+    // Dekodiert eine einzelne Benachrichtigung, egal ob sie als JSON oder binär
+    // kodiert wurde. Stapel liest decode_datagram().
     void decode(std::string_view str) {
-        auto doc = nlohmann::json::parse(str);
+        if (internal::wire::is_binary(str)) {
+            decode_binary(str);
+        } else {
+            decode_json(str);
+        }
+    }
+
+    // Binärformat (alle Zahlen Little Endian):
+    //
+    //   u8  Kennung/Version
+    //   u8  Länge der ID
+    //   ... ID
+    //   u64 power
+    //   f64 pos_x
+    //   f64 pos_y
+    //   u8  type (obere vier Bit: Index der Variante, untere vier Bit: Subtyp)
+    //   i64 timestamp (Millisekunden)
+    //
+    // Ein Stapel (batch_version) beginnt mit Kennung/Version und der Anzahl
+    // als u8, danach folgen die Benachrichtigungen jeweils ab der Länge der ID.
+    std::string encode_binary() const {
+        namespace wire = internal::wire;
+
+        std::string out(wire::fixed_size + id.size(), '\0');
+        out[0] = static_cast<char>(wire::magic | wire::version);
+        write_binary(out.data() + 1);
+        return out;
+    }
+
+    // Größe im Binärformat ohne das erste Byte, so steht sie auch in einem Stapel
+    std::size_t binary_size() const noexcept {
+        return internal::wire::fixed_size - 1 + id.size();
+    }
+
+    // Schreibt alle Felder ab der Länge der ID nach out, binary_size() Bytes
+    void write_binary(char* p) const {
+        namespace wire = internal::wire;
+
+        if (id.size() > 0xFF) {
+            throw std::runtime_error { "ID ist zu lang für das Binärformat" };
+        }
+        *p++ = static_cast<char>(id.size());
+        std::memcpy(p, id.data(), id.size());
+        p += id.size();
+        wire::store_le(p, power);
+        p += sizeof(power);
+        wire::store_le(p, pos_x);
+        p += sizeof(pos_x);
+        wire::store_le(p, pos_y);
+        p += sizeof(pos_y);
+        auto subtype = std::visit([](auto subtype) { return static_cast<std::uint8_t>(subtype); }, type);
+        *p++ = static_cast<char>((type.index() << 4) | subtype);
+        wire::store_le(p, timestamp);
+    }
+
+    void decode_binary(std::string_view str) {
+        namespace wire = internal::wire;
+
+        if (str.size() < wire::fixed_size) {
+            throw std::runtime_error { "Binärdatagramm ist zu kurz" };
+        }
+        if ((static_cast<std::uint8_t>(str[0]) & ~wire::magic_mask) != wire::version) {
+            throw std::runtime_error { "Nicht unterstützte Version des Binärformats" };
+        }
+        if (read_binary(str.data() + 1, str.data() + str.size()) != str.data() + str.size()) {
+            throw std::runtime_error { "Länge des Binärdatagramms passt nicht zur ID" };
+        }
+    }
+
+    // Liest die Felder ab der Länge der ID, wie sie write_binary() schreibt, und
+    // liefert die Position direkt dahinter
+    const char* read_binary(const char* p, const char* end) {
+        namespace wire = internal::wire;
+
+        if (static_cast<std::size_t>(end - p) < wire::fixed_size - 1) {
+            throw std::runtime_error { "Binärdatagramm ist zu kurz" };
+        }
+        auto id_length = static_cast<std::uint8_t>(*p++);
+        if (static_cast<std::size_t>(end - p) < wire::fixed_size - 2 + id_length) {
+            throw std::runtime_error { "Länge des Binärdatagramms passt nicht zur ID" };
+        }
+        id.assign(p, id_length);
+        p += id_length;
+        power = wire::load_le<decltype(power)>(p);
+        p += sizeof(power);
+        pos_x = wire::load_le<decltype(pos_x)>(p);
+        p += sizeof(pos_x);
+        pos_y = wire::load_le<decltype(pos_y)>(p);
+        p += sizeof(pos_y);
+        auto packed_type = static_cast<std::uint8_t>(*p++);
+        auto subtype = packed_type & 0x0F;
+        switch (packed_type >> 4) {
+        case 0:
+            if (subtype > static_cast<std::uint8_t>(producer_type::water)) {
+                throw std::runtime_error { "Nicht erlaubter subtype für Producer" };
+            }
+            type = static_cast<producer_type>(subtype);
+            break;
+        case 1:
+            if (subtype > static_cast<std::uint8_t>(consumer_type::industrial)) {
+                throw std::runtime_error { "Nicht erlaubter subtype für Consumer" };
+            }
+            type = static_cast<consumer_type>(subtype);
+            break;
+        default:
+            throw std::runtime_error { "Nicht erlaubter index für type" };
+        }
+        timestamp = wire::normalize_timestamp(wire::load_le<decltype(timestamp)>(p));
+        return p + sizeof(timestamp);
+    }
+
+    void decode_json(std::string_view str) {
+        internal::json::reader reader { str };
+        read_json(reader);
+        reader.expect_end();
+    }
+
+    // Liest eine JSON-kodierte Benachrichtigung ohne Umweg über einen
+    // Dokumentbaum direkt in die Felder. Unbekannte, doppelte oder fehlende
+    // Schlüssel werden abgelehnt.
+    void read_json(internal::json::reader& reader) {
+        enum field : unsigned {
+            field_id = 1 << 0,
+            field_power = 1 << 1,
+            field_pos_x = 1 << 2,
+            field_pos_y = 1 << 3,
+            field_type = 1 << 4,
+            field_subtype = 1 << 5,
+            field_timestamp = 1 << 6,
+            all_fields = (1 << 7) - 1,
+        };
+        static constexpr std::pair<std::string_view, field> known_fields[] {
+            { "id", field_id },
+            { "power", field_power },
+            { "pos_x", field_pos_x },
+            { "pos_y", field_pos_y },
+            { "type", field_type },
+            { "subtype", field_subtype },
+            { "timestamp", field_timestamp },
+        };
 
-        id = doc["id"].get<std::string>();
-        power = doc["power"].get<decltype(power)>();
-        pos_x = doc["pos_x"].get<decltype(pos_x)>();
-        pos_y = doc["pos_y"].get<decltype(pos_y)>();
-        switch (doc["type"].get<int>()) {
+        unsigned seen = 0;
+        std::uint64_t type_index = 0;
+        std::uint64_t subtype = 0;
+
+        reader.expect('{');
+        if (!reader.consume('}')) {
+            do {
+                auto key = reader.read_key();
+                auto it = std::find_if(std::begin(known_fields), std::end(known_fields),
+                    [key](const auto& known) { return known.first == key; });
+                if (it == std::end(known_fields)) {
+                    throw std::runtime_error { "Unbekannter Schlüssel \"" + std::string { key } + "\"" };
+                }
+                if (seen & it->second) {
+                    throw std::runtime_error { "Doppelter Schlüssel \"" + std::string { key } + "\"" };
+                }
+                seen |= it->second;
+
+                switch (it->second) {
+                case field_id:
+                    reader.read_string(id);
+                    break;
+                case field_power:
+                    power = reader.read_integer<decltype(power)>();
+                    break;
+                case field_pos_x:
+                    pos_x = reader.read_double();
+                    break;
+                case field_pos_y:
+                    pos_y = reader.read_double();
+                    break;
+                case field_type:
+                    type_index = reader.read_integer<std::uint64_t>();
+                    break;
+                case field_subtype:
+                    subtype = reader.read_integer<std::uint64_t>();
+                    break;
+                case field_timestamp:
+                    timestamp = internal::wire::normalize_timestamp(reader.read_integer<decltype(timestamp)>());
+                    break;
+                default:
+                    break;
+                }
+            } while (reader.consume(','));
+            reader.expect('}');
+        }
+
+        if (seen != all_fields) {
+            for (const auto& [name, flag] : known_fields) {
+                if (!(seen & flag)) {
+                    throw std::runtime_error { "Fehlender Schlüssel \"" + std::string { name } + "\"" };
+                }
+            }
+        }
+
+        switch (type_index) {
         case 0:
-            type = doc["subtype"].get<producer_type>();
+            if (subtype > static_cast<std::uint8_t>(producer_type::water)) {
+                throw std::runtime_error { "Nicht erlaubter subtype für Producer" };
+            }
+            type = static_cast<producer_type>(subtype);
             break;
         case 1:
-            type = doc["subtype"].get<consumer_type>();
+            if (subtype > static_cast<std::uint8_t>(consumer_type::industrial)) {
+                throw std::runtime_error { "Nicht erlaubter subtype für Consumer" };
+            }
+            type = static_cast<consumer_type>(subtype);
             break;
         default:
             throw std::runtime_error { "Nicht erlaubter index für type" };
         }
-        timestamp = doc["timestamp"].get<decltype(timestamp)>();
     }
 };
 
+// batch_writer packt mehrere Benachrichtigungen in ein Datagramm, damit der Hub
+// bei vielen Prosumern hinter einem Absender nicht jede einzeln empfangen muss.
+// Binär ist ein Stapel ein Datagramm mit batch_version, als JSON ein Array von
+// Benachrichtigungen.
+class batch_writer {
+    wire_format format_;
+    std::string buffer_ {};
+    std::size_t count_ { 0 };
+
+public:
+    // Höchstzahl an Benachrichtigungen pro Stapel, begrenzt durch das Zählerbyte
+    static constexpr std::size_t max_count = 0xFF;
+
+    explicit batch_writer(wire_format format) noexcept
+        : format_(format) { }
+
+    // Hängt die Benachrichtigung an, falls der Stapel danach höchstens max_size
+    // Bytes groß ist. Ein leerer Stapel nimmt jede Benachrichtigung an.
+    bool append(const notification& n, std::size_t max_size) {
+        if (count_ == max_count) {
+            return false;
+        }
+        if (format_ == wire_format::binary) {
+            if (buffer_.empty()) {
+                buffer_.push_back(static_cast<char>(internal::wire::magic | internal::wire::batch_version));
+                buffer_.push_back(0);
+            }
+            auto offset = buffer_.size();
+            if (count_ > 0 && offset + n.binary_size() > max_size) {
+                return false;
+            }
+            buffer_.resize(offset + n.binary_size());
+            n.write_binary(buffer_.data() + offset);
+            buffer_[1] = static_cast<char>(count_ + 1);
+        } else {
+            auto json = n.to_json().dump();
+            // Ein Zeichen für '[' bzw. ',' und eines für die schließende Klammer
+            if (count_ > 0 && buffer_.size() + json.size() + 2 > max_size) {
+                return false;
+            }
+            buffer_ += count_ == 0 ? '[' : ',';
+            buffer_ += json;
+        }
+        ++count_;
+        return true;
+    }
+
+    bool empty() const noexcept {
+        return count_ == 0;
+    }
+
+    std::size_t count() const noexcept {
+        return count_;
+    }
+
+    // Liefert das fertige Datagramm und beginnt einen neuen Stapel
+    std::string take() {
+        if (format_ == wire_format::json && count_ > 0) {
+            buffer_ += ']';
+        }
+        count_ = 0;
+        return std::exchange(buffer_, {});
+    }
+};
+
+// Dekodiert ein Datagramm mit einer einzelnen Benachrichtigung oder einem
+// Stapel und schreibt die Benachrichtigungen ab Index offset nach out. Dort
+// vorhandene Elemente werden wiederverwendet, damit ihre IDs keine neuen
+// Allokationen brauchen, bei Bedarf wächst out. Liefert den Index hinter der
+// letzten Benachrichtigung. Ist das Datagramm ungültig, wird eine Exception
+// geworfen und es zählt keine seiner Benachrichtigungen.
+inline std::size_t decode_datagram(std::string_view str, std::vector<notification>& out, std::size_t offset) {
+    auto slot = [&out](std::size_t i) -> notification& {
+        if (i < out.size()) {
+            return out[i];
+        }
+        return out.emplace_back();
+    };
+
+    if (internal::wire::is_binary(str)) {
+        if ((static_cast<std::uint8_t>(str[0]) & ~internal::wire::magic_mask) != internal::wire::batch_version) {
+            slot(offset).decode_binary(str);
+            return offset + 1;
+        }
+        if (str.size() < 2) {
+            throw std::runtime_error { "Stapel ist zu kurz" };
+        }
+        auto count = static_cast<std::uint8_t>(str[1]);
+        const auto* p = str.data() + 2;
+        const auto* end = str.data() + str.size();
+        for (std::size_t i = 0; i < count; ++i) {
+            p = slot(offset + i).read_binary(p, end);
+        }
+        if (p != end) {
+            throw std::runtime_error { "Länge des Stapels passt nicht zur Anzahl" };
+        }
+        return offset + count;
+    }
+
+    internal::json::reader reader { str };
+    if (!reader.consume('[')) {
+        slot(offset).decode_json(str);
+        return offset + 1;
+    }
+    auto index = offset;
+    if (!reader.consume(']')) {
+        do {
+            slot(index++).read_json(reader);
+        } while (reader.consume(','));
+        reader.expect(']');
+    }
+    reader.expect_end();
+    return index;
+}
+
 };
\ No newline at end of file
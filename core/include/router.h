@@ -1,16 +1,21 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <exception>
-#include <functional>
-#include <iostream>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include <boost/asio.hpp>
 
+#include "log.h"
 #include "session.h"
 
 namespace core {
@@ -18,112 +23,443 @@ template <typename Socket> class router {
     using req = typename session<Socket>::req;
     using res = typename session<Socket>::res;
 
-    using predicate = std::function<bool(req&)>;
-    using handler
-        = std::function<boost::asio::awaitable<void>(res&, req&, std::function<boost::asio::awaitable<void>()>)>;
-    using middleware = std::pair<predicate, handler>;
-
 public:
-    class next {
-        using middleware_iterator = typename std::vector<middleware>::const_iterator;
+    class group;
+    class next;
 
-        middleware_iterator it_;
-        middleware_iterator end_;
-        req& req_;
-        res& res_;
-        bool moved_to_next{false};
+    // Ein Glied der Middleware-Kette. Der Handler wird beim Registrieren einmal
+    // typgelöscht, beim Durchlaufen der Kette wird dadurch nichts allokiert.
+    class link {
+    public:
+        enum class scope { all, prefix, exact };
+
+        // Ergebnis eines Glieds: Synchrone Middleware lässt die Kette direkt
+        // weiterlaufen (proceed) oder beendet sie, eine Coroutine übernimmt den
+        // Rest der Kette selbst (task).
+        struct step {
+            bool proceed { true };
+            std::optional<boost::asio::awaitable<void>> task {};
+        };
+
+    private:
+        scope scope_;
+        std::string match_;
+
+    public:
+        link(scope scope, std::string match)
+            : scope_(scope)
+            , match_(std::move(match)) { }
+
+        virtual ~link() = default;
 
-        void move_to_next() {
-            if(moved_to_next) {
-                return;
+        bool matches(const req& req) const {
+            switch (scope_) {
+            case scope::prefix:
+                return req.url.starts_with(match_);
+            case scope::exact:
+                return req.url == match_;
+            default:
+                return true;
             }
+        }
 
-            for (; it_ != end_; ++it_) {
-                if (!(*it_).first(req_)) {
-                    continue;
-                }
-                return;
+        virtual step invoke(res& res, req& req, next next) const = 0;
+
+        virtual bool has_after() const { return false; }
+        virtual void after(res& res, req& req) const { }
+    };
+
+    // Eine Middleware hat eine der folgenden Formen:
+    //  - (res&, req&, next) -> awaitable<void>: Coroutine, die selbst next() aufruft
+    //  - (res&, req&) -> void: läuft ohne eigenen Coroutine-Frame, danach geht
+    //    es mit der nächsten Middleware weiter
+    //  - (res&, req&) -> bool: wie oben, bei false endet die Kette
+    template <typename Handler> class handler_link : public link {
+        Handler h_;
+
+        static constexpr bool is_coroutine = std::is_invocable_v<const Handler&, res&, req&, next>;
+
+    public:
+        handler_link(typename link::scope scope, std::string match, Handler h)
+            : link(scope, std::move(match))
+            , h_(std::move(h)) { }
+
+        typename link::step invoke(res& res, req& req, next next) const override {
+            if constexpr (is_coroutine) {
+                return { false, h_(res, req, next) };
+            } else if constexpr (std::is_same_v<decltype(h_(res, req)), bool>) {
+                return { h_(res, req) };
+            } else {
+                h_(res, req);
+                return {};
             }
-            throw std::runtime_error { "Keine Middleware mehr vorhanden" };
         }
+    };
+
+    // Synchrone Middleware mit einem zweiten Teil, der nach dem Rest der Kette läuft
+    template <typename Before, typename After> class around_link : public handler_link<Before> {
+        After after_;
+
+    public:
+        around_link(Before before, After after)
+            : handler_link<Before>(link::scope::all, {}, std::move(before))
+            , after_(std::move(after)) { }
+
+        bool has_after() const override { return true; }
+        void after(res& res, req& req) const override { after_(res, req); }
+    };
+
+    // next ist klein und wird als Wert weitergereicht. Der Aufruf lässt alle
+    // synchronen Glieder direkt laufen und liefert die Coroutine des nächsten
+    // asynchronen Glieds, ohne selbst einen Frame anzulegen.
+    class next {
+        const group* group_;
+        std::size_t index_;
+        req& req_;
+        res& res_;
+        std::size_t* reached_;
 
     public:
-        next(middleware_iterator it, middleware_iterator end, req& req, res& res)
-            : it_(it)
-            , end_(end)
+        next(const group* group, std::size_t index, req& req, res& res, std::size_t* reached)
+            : group_(group)
+            , index_(index)
             , req_(req)
-            , res_(res) { }
+            , res_(res)
+            , reached_(reached) { }
 
-        boost::asio::awaitable<void> operator()() {
-            move_to_next();
-            return (*it_).second(res_, req_, next { it_ + 1, end_, req_, res_ });
-        }
+        boost::asio::awaitable<void> operator()() const { return group_->run(index_, res_, req_, reached_); }
     };
 
     class group {
-        std::vector<middleware> middleware_;
-
-        static constexpr auto true_predicate = [](auto& req) { return true; };
+        std::vector<std::unique_ptr<link>> links_ {};
 
         struct exact_match_t {};
 
+        static boost::asio::awaitable<void> done() { co_return; }
+
+        friend class next;
+
+        boost::asio::awaitable<void> run(std::size_t index, res& res, req& req, std::size_t* reached) const {
+            for (; index < links_.size(); ++index) {
+                const auto& l = *links_[index];
+                if (!l.matches(req)) {
+                    continue;
+                }
+                *reached = std::max(*reached, index + 1);
+
+                auto step = l.invoke(res, req, next { this, index + 1, req, res, reached });
+                if (step.task) {
+                    return std::move(*step.task);
+                }
+                if (!step.proceed) {
+                    return done();
+                }
+            }
+            throw std::runtime_error { "Keine Middleware mehr vorhanden" };
+        }
+
     public:
-        static constexpr auto exact_match = exact_match_t{};
+        static constexpr auto exact_match = exact_match_t {};
 
         template <typename Handler> void use(Handler&& h) {
-            middleware_.emplace_back(true_predicate, std::forward<Handler>(h));
+            add(link::scope::all, {}, std::forward<Handler>(h));
         }
 
         template <typename Handler> void use(std::string_view prefix, Handler&& h) {
-            std::string prefix_str {prefix};
-            middleware_.emplace_back([prefix = std::move(prefix_str)](auto& req){
-                return req.url.starts_with(prefix);
-            }, std::forward<Handler>(h));
+            add(link::scope::prefix, std::string { prefix }, std::forward<Handler>(h));
         }
 
-        template <typename Handler>
-        void use(std::string_view match, exact_match_t, Handler&& h) {
-            std::string match_str {match};
-            middleware_.emplace_back([match = std::move(match_str)](auto& req){
-                return req.url == match;
-            }, std::forward<Handler>(h));
+        template <typename Handler> void use(std::string_view match, exact_match_t, Handler&& h) {
+            add(link::scope::exact, std::string { match }, std::forward<Handler>(h));
         }
 
-        boost::asio::awaitable<void> operator()(res& res, req& req) {
-            co_await(next { middleware_.cbegin(), middleware_.cend(), req, res })();
+        // Synchrone Middleware, deren zweiter Teil after(res, req) läuft, wenn
+        // der Rest der Kette fertig ist, etwa zum Loggen der Response
+        template <typename Before, typename After>
+            requires(!std::is_convertible_v<Before, std::string_view>
+                && std::is_invocable_v<const std::decay_t<After>&, res&, req&>)
+        void use(Before&& before, After&& after) {
+            links_.push_back(std::make_unique<around_link<std::decay_t<Before>, std::decay_t<After>>>(
+                std::forward<Before>(before), std::forward<After>(after)));
         }
 
-        boost::asio::awaitable<void> operator()(res& res, req& req, auto next) { return (*this)(res, req); }
+        template <typename Handler> void add(typename link::scope scope, std::string match, Handler&& h) {
+            links_.push_back(std::make_unique<handler_link<std::decay_t<Handler>>>(
+                scope, std::move(match), std::forward<Handler>(h)));
+        }
+
+        void add(std::unique_ptr<link> l) { links_.push_back(std::move(l)); }
+
+        // Durchläuft die Kette für eine Request. Fehler werden hier abgefangen und
+        // geloggt, danach laufen die zweiten Teile der erreichten Middleware in
+        // umgekehrter Reihenfolge. Pro Request entsteht dafür ein einziger Frame.
+        boost::asio::awaitable<void> operator()(res& res, req& req) const {
+            std::size_t reached = 0;
+            try {
+                co_await next { this, 0, req, res, &reached }();
+            } catch (std::exception& err) {
+                log::error("Bei der Behandlung der HTTP-Verbindung ist ein Fehler aufgetreten")
+                    .field("error", err.what());
+            } catch (...) {
+                log::error("Bei der Behandlung der HTTP-Verbindung ist ein unbekannter Fehler aufgetreten");
+            }
+
+            for (auto i = reached; i-- > 0;) {
+                if (links_[i]->has_after()) {
+                    links_[i]->after(res, req);
+                }
+            }
+        }
+
+        boost::asio::awaitable<void> operator()(res& res, req& req, next) const { return (*this)(res, req); }
     };
 
 private:
-    group root_group_;
+    // route_tree ordnet Pfade wie /api/v1/prosumers/:id in einem Präfixbaum über
+    // die Pfadsegmente an. Jeder Knoten hat feste Kinder, die über ihr Segment
+    // binär gesucht werden, und höchstens ein Kind für einen Parameter (:name).
+    // Die Suche kostet damit nur so viele Schritte, wie der Pfad Segmente hat,
+    // unabhängig von der Zahl der Routen. Feste Segmente haben Vorrang vor
+    // Parametern.
+    class route_tree {
+        static constexpr std::size_t verb_count = 5;
+
+        struct node {
+            std::vector<std::pair<std::string, std::unique_ptr<node>>> children {};
+            std::unique_ptr<node> param_child {};
+            std::string param_name {};
+            std::array<std::unique_ptr<link>, verb_count> handlers {};
+            std::string pattern {};
+
+            bool has_handler() const {
+                return std::any_of(handlers.begin(), handlers.end(), [](const auto& h) { return bool(h); });
+            }
+        };
+
+        node root_ {};
+
+        // Liefert das nächste nicht leere Segment und entfernt es aus path
+        static std::string_view next_segment(std::string_view& path) {
+            while (path.starts_with('/')) {
+                path.remove_prefix(1);
+            }
+            auto end = path.find('/');
+            auto segment = path.substr(0, end);
+            path.remove_prefix(segment.size());
+            return segment;
+        }
+
+        static node* find_child(const node& n, std::string_view segment) {
+            auto it = std::lower_bound(n.children.begin(), n.children.end(), segment,
+                [](const auto& child, std::string_view segment) { return child.first < segment; });
+            if (it == n.children.end() || it->first != segment) {
+                return nullptr;
+            }
+            return it->second.get();
+        }
+
+        static const node* match(const node& n, std::string_view path, http::path_params& params) {
+            auto segment = next_segment(path);
+            if (segment.empty()) {
+                return n.has_handler() ? &n : nullptr;
+            }
+
+            if (auto* child = find_child(n, segment)) {
+                if (auto* found = match(*child, path, params)) {
+                    return found;
+                }
+            }
+
+            if (n.param_child) {
+                auto size = params.size();
+                if (params.add(n.param_name, segment)) {
+                    if (auto* found = match(*n.param_child, path, params)) {
+                        return found;
+                    }
+                    params.truncate(size);
+                }
+            }
+            return nullptr;
+        }
+
+    public:
+        void insert(http::verb verb, std::string_view pattern, std::unique_ptr<link> h) {
+            std::string full_pattern { pattern };
+            auto* n = &root_;
+            for (auto segment = next_segment(pattern); !segment.empty(); segment = next_segment(pattern)) {
+                if (segment.starts_with(':')) {
+                    auto name = segment.substr(1);
+                    if (!n->param_child) {
+                        n->param_child = std::make_unique<node>();
+                        n->param_name = name;
+                    } else if (n->param_name != name) {
+                        throw std::invalid_argument { "Widersprüchliche Namen für denselben Pfadparameter" };
+                    }
+                    n = n->param_child.get();
+                    continue;
+                }
+
+                auto it = std::lower_bound(n->children.begin(), n->children.end(), segment,
+                    [](const auto& child, std::string_view segment) { return child.first < segment; });
+                if (it == n->children.end() || it->first != segment) {
+                    it = n->children.emplace(it, std::string { segment }, std::make_unique<node>());
+                }
+                n = it->second.get();
+            }
+
+            auto& slot = n->handlers[static_cast<std::size_t>(verb)];
+            if (slot) {
+                throw std::invalid_argument { "Route ist bereits registriert" };
+            }
+            slot = std::move(h);
+            n->pattern = full_pattern;
+        }
+
+        // Sucht die Route zum Pfad und vermerkt ihr Muster in route. Passt der
+        // Pfad, aber nicht das Verb, wird nullptr geliefert und allowed enthält
+        // die Verben, die es für den Pfad gibt, als Bitmaske (Bit i für Verb i).
+        // Sonst ist allowed 0.
+        const link* find(http::verb verb, std::string_view path, http::path_params& params, std::string_view& route,
+            unsigned& allowed) const {
+            allowed = 0;
+            auto* n = match(root_, path, params);
+            if (!n) {
+                return nullptr;
+            }
+            const auto& h = n->handlers[static_cast<std::size_t>(verb)];
+            route = n->pattern;
+            if (!h) {
+                params.clear();
+                for (std::size_t i = 0; i < verb_count; ++i) {
+                    if (n->handlers[i]) {
+                        allowed |= 1u << i;
+                    }
+                }
+                return nullptr;
+            }
+            return h.get();
+        }
+
+        // Hängt alle registrierten Kombinationen aus Verb und Muster an out an
+        void collect(std::vector<std::pair<http::verb, std::string_view>>& out) const { collect(root_, out); }
+
+    private:
+        static void collect(const node& n, std::vector<std::pair<http::verb, std::string_view>>& out) {
+            for (std::size_t verb = 0; verb < verb_count; ++verb) {
+                if (n.handlers[verb]) {
+                    out.emplace_back(static_cast<http::verb>(verb), n.pattern);
+                }
+            }
+            for (const auto& [segment, child] : n.children) {
+                collect(*child, out);
+            }
+            if (n.param_child) {
+                collect(*n.param_child, out);
+            }
+        }
+    };
+
+    // Die Routen bilden gemeinsam ein Glied der Middleware-Kette, und zwar an der
+    // Stelle, an der die erste Route registriert wurde. Passt eine Route, liefert
+    // das Glied direkt die Coroutine ihres Handlers.
+    class route_link : public link {
+    public:
+        route_tree tree {};
+
+        route_link()
+            : link(link::scope::all, {}) { }
+
+        typename link::step invoke(res& res, req& req, next next) const override {
+            unsigned allowed;
+            if (auto* h = tree.find(req.verb, req.path(), req.params, req.route, allowed)) {
+                return h->invoke(res, req, next);
+            }
+            if (allowed) {
+                // Eine 405 muss die erlaubten Verben nennen (RFC 7231, 6.5.5)
+                std::string verbs;
+                for (std::size_t i = 0; allowed >> i; ++i) {
+                    if (allowed & (1u << i)) {
+                        if (!verbs.empty()) {
+                            verbs += ", ";
+                        }
+                        verbs += http::to_string(static_cast<http::verb>(i));
+                    }
+                }
+                res.fields["Allow"] = std::move(verbs);
+                res.status_code = http::status_code::method_not_allowed;
+                return { false };
+            }
+            return {};
+        }
+    };
+
+    // Die Kette wird von allen Verbindungen gemeinsam benutzt und nicht kopiert
+    std::shared_ptr<group> root_group_ { std::make_shared<group>() };
+    typename session<Socket>::options session_options_ {};
+    route_link* routes_ { nullptr };
+
+    template <typename Handler> void route(http::verb verb, std::string_view pattern, Handler&& h) {
+        if (!routes_) {
+            auto routes = std::make_unique<route_link>();
+            routes_ = routes.get();
+            root_group_->add(std::move(routes));
+        }
+        routes_->tree.insert(verb, pattern,
+            std::make_unique<handler_link<std::decay_t<Handler>>>(link::scope::all, std::string {},
+                std::forward<Handler>(h)));
+    }
 
 public:
     static constexpr auto exact_match = group::exact_match;
 
-    router() {
-        // Standard Middleware für Fehlerbehandlung
-        root_group_.use([](auto& res, auto& req, auto next) -> boost::asio::awaitable<void> {
-            try {
-                co_await next();
-            } /* catch (std::runtime_error& err) {
+    using session_options = typename session<Socket>::options;
 
-             }*/
-            catch (std::exception& err) {
-                std::cerr << "Bei der Behandlung der HTTP-Verbindung ist ein Fehler aufgetreten: " << err.what()
-                          << std::endl;
-            } catch (...) {
-                std::cerr << "Bei der Behandlung der HTTP-Verbindung ist ein unbekannter Fehler aufgetreten"
-                          << std::endl;
-            }
-        });
+    template <typename... Args> void use(Args&&... args) { root_group_->use(std::forward<Args>(args)...); }
+
+    // Registriert einen Handler für ein Verb und ein Pfadmuster. Segmente der
+    // Form :name sind Parameter und stehen dem Handler über req.param("name")
+    // zur Verfügung. Query-String und Schrägstriche am Ende werden beim
+    // Vergleich ignoriert. Ruft der Handler next() auf, geht es mit der
+    // Middleware nach den Routen weiter.
+    template <typename Handler> void get(std::string_view pattern, Handler&& h) {
+        route(http::verb::GET, pattern, std::forward<Handler>(h));
+    }
+
+    template <typename Handler> void post(std::string_view pattern, Handler&& h) {
+        route(http::verb::POST, pattern, std::forward<Handler>(h));
+    }
+
+    template <typename Handler> void put(std::string_view pattern, Handler&& h) {
+        route(http::verb::PUT, pattern, std::forward<Handler>(h));
+    }
+
+    template <typename Handler> void patch(std::string_view pattern, Handler&& h) {
+        route(http::verb::PATCH, pattern, std::forward<Handler>(h));
+    }
+
+    template <typename Handler> void del(std::string_view pattern, Handler&& h) {
+        route(http::verb::DELETE, pattern, std::forward<Handler>(h));
+    }
+
+    // Alle registrierten Routen. Die Muster bleiben so lange gültig wie der
+    // Router und sind dieselben, die eine Request in req.route bekommt.
+    std::vector<std::pair<http::verb, std::string_view>> routes() const {
+        std::vector<std::pair<http::verb, std::string_view>> result;
+        if (routes_) {
+            routes_->tree.collect(result);
+        }
+        return result;
     }
 
-    template <typename... Args> void use(Args&&... args) { root_group_.use(std::forward<Args>(args)...); }
+    // Einstellungen für Keep-Alive, gelten für alle danach angenommenen Verbindungen
+    void set_session_options(session_options options) { session_options_ = options; }
 
     template <typename CompletionToken> auto handle_connection(Socket socket, CompletionToken&& token) {
-        return session<Socket>::co_spawn(std::move(socket), root_group_, std::forward<CompletionToken>(token));
+        return session<Socket>::co_spawn(
+            std::move(socket),
+            [chain = root_group_](res& res, req& req) { return (*chain)(res, req); },
+            session_options_,
+            std::forward<CompletionToken>(token));
     }
 };
 
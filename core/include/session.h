@@ -1,11 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <system_error>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
 #include <boost/asio.hpp>
 
 #include "http.h"
@@ -13,52 +28,537 @@
 
 namespace core {
 template <typename Socket> class session {
+    class idle_timer;
+
 public:
+    class req;
+    class res;
+
+    // Einstellungen für persistente Verbindungen (Keep-Alive)
+    struct options {
+        // Wie lange auf die nächste Request gewartet wird, bevor die Verbindung
+        // geschlossen wird. Beim Lesen des Bodys gilt dieselbe Zeit für jedes
+        // einzelne Lesen vom Socket.
+        std::chrono::steady_clock::duration idle_timeout { std::chrono::seconds { 5 } };
+
+        // Nach so vielen Requests wird die Verbindung geschlossen
+        std::size_t max_requests { 100 };
+
+        // Einen nicht gelesenen Body bis zu dieser Größe verwirft die Session,
+        // um die Verbindung weiter nutzen zu können. Ist er größer, wird die
+        // Verbindung geschlossen.
+        std::size_t max_skipped_body { 64 * 1024 };
+
+        // Wird nach jeder beantworteten Request aufgerufen, wenn die Response
+        // vollständig geschrieben ist. Status und gesendete Bytes sind dann
+        // endgültig, auch für Fehler, die erst die Session selbst beantwortet.
+        std::function<void(const res&, const req&)> on_complete {};
+    };
+
     class req : public http::req {
         friend session;
 
+        // Wie der Body der Request übertragen wird
+        enum class body_mode { none, content_length, chunked };
+
+        // Zustand beim Dekodieren von Transfer-Encoding: chunked
+        enum class chunk_state { size, data, data_end, trailer, done };
+
+        // Maximale Länge einer Zeile mit Chunk-Größe oder Trailer
+        static constexpr std::size_t max_chunk_line = 1024;
+
         Socket& s_;
         bool header_read_ { false };
 
+        // Schließt das Socket, wenn ein Client den Body zu langsam schickt
+        idle_timer* idle_ { nullptr };
+        std::chrono::steady_clock::duration read_timeout_ {};
+        bool socket_taken_ { false };
+
+        // Empfangspuffer. Am Anfang liegt der Header-Block, auf den die Felder
+        // verweisen, deshalb wird er erst vor der nächsten Request verworfen.
+        // Dahinter folgen noch nicht gelesene Bytes des Bodys und eventuell
+        // schon die nächste Request.
+        std::string raw_ {};
+        std::size_t header_size_ { 0 };
+
+        body_mode body_mode_ { body_mode::none };
+        chunk_state chunk_state_ { chunk_state::size };
+
+        // Restliche Bytes des Bodys bzw. des aktuellen Chunks
+        std::uint64_t remaining_ { 0 };
+
+        // Länge des zuletzt zurückgegebenen Stücks, das noch hinter dem Header liegt
+        std::size_t returned_ { 0 };
+
+        bool expects_continue_ { false };
+
+        // Fehler beim Lesen des Bodys, auf den die Session noch antworten muss
+        std::error_code body_error_ {};
+
+        [[noreturn]] void fail_body(http::error error) {
+            body_error_ = http::make_error_code(error);
+            throw std::system_error { body_error_ };
+        }
+
         boost::asio::awaitable<void> async_read_header() {
-            co_await http::async_read_request(s_, buffer, *this, boost::asio::use_awaitable);
+            // use_awaitable wirft nur bei boost::system::error_code, ein
+            // std::error_code kommt als Rückgabewert zurück
+            auto buffer = boost::asio::dynamic_buffer(raw_);
+            auto [ec, header_size]
+                = co_await http::async_read_request(s_, buffer, *this, boost::asio::use_awaitable);
+            if (ec) {
+                throw std::system_error { ec };
+            }
+            header_size_ = header_size;
             header_read_ = true;
+
+            if (auto ec = prepare_body()) {
+                throw std::system_error { ec };
+            }
+        }
+
+        // Bestimmt anhand der Header-Felder, wie der Body übertragen wird
+        std::error_code prepare_body() {
+            if (auto transfer_encoding = field("Transfer-Encoding")) {
+                // Ohne chunked als letzte Kodierung lässt sich das Ende des Bodys nicht bestimmen
+                auto last = transfer_encoding->substr(transfer_encoding->rfind(',') + 1);
+                if (!http::internal::has_token(last, "chunked")) {
+                    return http::make_error_code(http::error::malformed_request);
+                }
+                body_mode_ = body_mode::chunked;
+                chunk_state_ = chunk_state::size;
+            } else if (auto content_length = field("Content-Length")) {
+                auto [ptr, ec] = std::from_chars(
+                    content_length->data(), content_length->data() + content_length->size(), remaining_, 10);
+                if (ec != std::errc {} || ptr != content_length->data() + content_length->size()) {
+                    return http::make_error_code(http::error::malformed_request);
+                }
+                body_mode_ = remaining_ ? body_mode::content_length : body_mode::none;
+            }
+
+            if (body_mode_ != body_mode::none) {
+                auto expect = field("Expect");
+                expects_continue_ = protocol == http::protocol::http11 && expect
+                    && http::internal::iequals(*expect, "100-continue");
+            }
+            return {};
+        }
+
+        // Bytes hinter dem Header, die bereits empfangen wurden
+        std::string_view pending() const noexcept {
+            return std::string_view { raw_ }.substr(header_size_);
+        }
+
+        // Entfernt n Bytes direkt hinter dem Header aus dem Puffer
+        void drop(std::size_t n) {
+            raw_.erase(header_size_, n);
+        }
+
+        // Liest weitere Bytes vom Socket an das Ende des Puffers
+        boost::asio::awaitable<void> async_fill() {
+            // Der Client wartet mit dem Body, bis wir ihn ausdrücklich anfordern
+            if (expects_continue_) {
+                expects_continue_ = false;
+                co_await boost::asio::async_write(
+                    s_, boost::asio::buffer(std::string_view { "HTTP/1.1 100 Continue\r\n\r\n" }),
+                    boost::asio::use_awaitable);
+            }
+
+            auto old_size = raw_.size();
+            raw_.resize(old_size + http::internal::read_chunk_size);
+            boost::system::error_code ec;
+            if (idle_) {
+                idle_->arm(read_timeout_);
+            }
+            auto n = co_await s_.async_read_some(
+                boost::asio::buffer(raw_.data() + old_size, http::internal::read_chunk_size),
+                boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            if (idle_) {
+                idle_->disarm();
+            }
+            raw_.resize(old_size + n);
+
+            // Der Timer hat das Socket geschlossen
+            if (ec == boost::asio::error::operation_aborted && !s_.is_open()) {
+                ec = boost::asio::error::timed_out;
+            }
+
+            // Der Puffer kann beim Wachsen verschoben worden sein
+            fields.rebase(raw_.data());
+
+            if (ec) {
+                throw boost::system::system_error { ec };
+            }
+        }
+
+        // Liest eine Zeile (ohne \r\n) direkt hinter dem Header, ohne sie zu entfernen
+        boost::asio::awaitable<std::string_view> async_peek_line() {
+            for (;;) {
+                auto eol = pending().find("\r\n");
+                if (eol != std::string_view::npos) {
+                    co_return pending().substr(0, eol);
+                }
+                if (pending().size() > max_chunk_line) {
+                    fail_body(http::error::malformed_body);
+                }
+                co_await async_fill();
+            }
+        }
+
+        // Ein Stück des Bodys aus dem Puffer zurückgeben, höchstens max Bytes
+        std::string_view take(std::size_t max) {
+            auto n = static_cast<std::size_t>(std::min<std::uint64_t>({ pending().size(), remaining_, max }));
+            remaining_ -= n;
+            returned_ = n;
+            return pending().substr(0, n);
+        }
+
+        boost::asio::awaitable<std::string_view> async_read_chunked(std::size_t max) {
+            for (;;) {
+                switch (chunk_state_) {
+                case chunk_state::size: {
+                    auto line = co_await async_peek_line();
+                    auto size = line.substr(0, line.find(';'));
+                    while (!size.empty() && (size.back() == ' ' || size.back() == '\t')) {
+                        size.remove_suffix(1);
+                    }
+                    auto [ptr, ec] = std::from_chars(size.data(), size.data() + size.size(), remaining_, 16);
+                    if (size.empty() || ec != std::errc {} || ptr != size.data() + size.size()) {
+                        fail_body(http::error::malformed_body);
+                    }
+                    drop(line.size() + 2);
+                    chunk_state_ = remaining_ ? chunk_state::data : chunk_state::trailer;
+                    break;
+                }
+                case chunk_state::data:
+                    if (remaining_ == 0) {
+                        chunk_state_ = chunk_state::data_end;
+                        break;
+                    }
+                    if (pending().empty()) {
+                        co_await async_fill();
+                    }
+                    co_return take(max);
+                case chunk_state::data_end:
+                    while (pending().size() < 2) {
+                        co_await async_fill();
+                    }
+                    if (!pending().starts_with("\r\n")) {
+                        fail_body(http::error::malformed_body);
+                    }
+                    drop(2);
+                    chunk_state_ = chunk_state::size;
+                    break;
+                case chunk_state::trailer: {
+                    // Trailer-Felder werden ignoriert, eine Leerzeile beendet den Body
+                    auto line = co_await async_peek_line();
+                    drop(line.size() + 2);
+                    if (line.empty()) {
+                        chunk_state_ = chunk_state::done;
+                    }
+                    break;
+                }
+                case chunk_state::done:
+                    co_return std::string_view {};
+                }
+            }
+        }
+
+        // Setzt die Request für die nächste Runde auf der Verbindung zurück. Die
+        // Kapazitäten der Strings und des Puffers bleiben erhalten. Bereits
+        // empfangene Bytes einer nachfolgenden Request (Pipelining) bleiben im
+        // Puffer liegen.
+        void reset() {
+            raw_.erase(0, header_size_);
+            header_size_ = 0;
+            verb = http::verb::GET;
+            url.clear();
+            protocol = http::protocol::http11;
+            fields.clear();
+            params.clear();
+            route = {};
+            body.clear();
+            header_read_ = false;
+            body_mode_ = body_mode::none;
+            remaining_ = 0;
+            returned_ = 0;
+            expects_continue_ = false;
+            body_error_.clear();
+        }
+
+        // Verwirft den Rest des Bodys, den der Handler nicht gelesen hat, damit
+        // die nächste Request auf der Verbindung beginnen kann. Ist er länger als
+        // limit, lohnt sich das nicht und es wird false zurückgegeben.
+        boost::asio::awaitable<bool> async_skip_body(std::size_t limit) {
+            // Hat der Client noch nichts geschickt, wartet er auf 100 Continue
+            // und die Verbindung muss ohnehin geschlossen werden.
+            if (expects_continue_) {
+                co_return false;
+            }
+            std::size_t skipped = 0;
+            for (;;) {
+                auto piece = co_await async_read_some_body();
+                if (piece.empty()) {
+                    drop(returned_);
+                    returned_ = 0;
+                    co_return true;
+                }
+                skipped += piece.size();
+                if (skipped > limit) {
+                    co_return false;
+                }
+            }
         }
 
     public:
+        // Der vollständige Body nach async_read_body()
         std::string body;
-        boost::asio::dynamic_string_buffer<char, std::char_traits<char>, std::allocator<char>> buffer;
 
         req(Socket& s)
-            : s_(s)
-            , buffer(body) { }
-        
+            : s_(s) { }
+
+        // Übernimmt das Socket, z.B. für eine WebSocket-Verbindung. Die Session
+        // beendet sich danach, ohne das Socket weiter anzufassen.
         Socket&& get_socket() && {
+            socket_taken_ = true;
             return std::move(s_);
         }
 
-        void async_read_request() {
-            return [](req& self) mutable -> boost::asio::awaitable<std::size_t> {
-                if (!self.header_read_) {
-                    co_await self.async_read_header();
+        // Liest das nächste Stück des Bodys, höchstens max Bytes. Das Stück
+        // verweist in den Empfangspuffer und bleibt bis zum nächsten Aufruf
+        // gültig. Ein leeres Stück bedeutet, dass der Body zu Ende ist.
+        // Transfer-Encoding: chunked wird dabei bereits dekodiert.
+        boost::asio::awaitable<std::string_view> async_read_some_body(
+            std::size_t max = http::internal::read_chunk_size) {
+            drop(returned_);
+            returned_ = 0;
+
+            switch (body_mode_) {
+            case body_mode::none:
+                co_return std::string_view {};
+            case body_mode::content_length:
+                if (remaining_ == 0) {
+                    co_return std::string_view {};
                 }
-                auto written = co_await boost::asio::async_write(self.s_, self.buffer, boost::asio::use_awaitable);
-                co_return written;
-            }(*this);
+                if (pending().empty()) {
+                    co_await async_fill();
+                }
+                co_return take(max);
+            case body_mode::chunked:
+                co_return co_await async_read_chunked(max);
+            }
+            co_return std::string_view {};
+        }
+
+        // Liest den gesamten Body nach body, sofern er nicht größer als limit
+        // ist. Sonst wird error::body_too_large geworfen und die Session
+        // antwortet mit 413, falls der Handler noch nichts geschrieben hat. Bei
+        // einem fehlerhaft kodierten Body antwortet sie entsprechend mit 400.
+        boost::asio::awaitable<std::string_view> async_read_body(std::size_t limit) {
+            body.clear();
+            if (body_mode_ == body_mode::content_length && remaining_ > limit) {
+                fail_body(http::error::body_too_large);
+            }
+            for (;;) {
+                auto piece = co_await async_read_some_body();
+                if (piece.empty()) {
+                    co_return std::string_view { body };
+                }
+                if (body.size() + piece.size() > limit) {
+                    fail_body(http::error::body_too_large);
+                }
+                body.append(piece);
+            }
+        }
+    };
+
+    class res;
+
+    // chunked_writer schreibt den Body einer Antwort stückweise, ohne dass seine
+    // Länge vorher bekannt sein muss. Daten werden gesammelt und als Chunk von
+    // mindestens flush_threshold Bytes verschickt (Transfer-Encoding: chunked).
+    // Bei HTTP/1.0 wird der Body ungerahmt geschrieben und die Verbindung danach
+    // geschlossen. Der Puffer gehört der Antwort und wird für alle Requests der
+    // Verbindung wiederverwendet.
+    class chunked_writer {
+        res& res_;
+        std::size_t flush_threshold_;
+
+    public:
+        chunked_writer(res& res, std::size_t flush_threshold)
+            : res_(res)
+            , flush_threshold_(flush_threshold) { }
+
+        // Hängt data an und verschickt den Puffer, sobald er voll genug ist
+        boost::asio::awaitable<void> async_write(std::string_view data) {
+            res_.chunk_buffer_.append(data);
+            if (res_.chunk_buffer_.size() >= flush_threshold_) {
+                co_await res_.async_flush_chunk();
+            }
+        }
+
+        // Direkter Zugriff auf den Puffer, z.B. zum Serialisieren ohne
+        // Zwischenkopie. Danach sollte async_write({}) aufgerufen werden.
+        std::string& buffer() noexcept {
+            return res_.chunk_buffer_;
+        }
+
+        // Verschickt alles Gesammelte sofort als eigenen Chunk
+        boost::asio::awaitable<void> async_flush() {
+            co_await res_.async_flush_chunk();
+        }
+
+        // Verschickt den Rest und beendet den Body
+        boost::asio::awaitable<void> async_finish() {
+            co_await res_.async_finish_chunked();
         }
     };
 
     class res : public http::res {
+        friend session;
+        friend chunked_writer;
+
+        // Höchstens so viele Bytes pro sendfile-Aufruf, damit ein einzelner Aufruf
+        // den Thread nicht zu lange belegt
+        static constexpr std::uint64_t max_sendfile_size = 1024 * 1024;
+
         Socket& s_;
         bool header_written_ { false };
+        bool keep_alive_ { false };
+
+        // Zustand einer Antwort mit chunked_writer
+        bool chunked_ { false };
+        bool chunked_open_ { false };
+        std::string chunk_buffer_ {};
+
+        // Bisher geschriebene Bytes des Bodys, ohne Header und Chunk-Rahmen
+        std::uint64_t body_bytes_ { 0 };
+
+        void reset() {
+            protocol = http::protocol::http11;
+            status_code = http::status_code::ok;
+            fields.clear();
+            header_written_ = false;
+            keep_alive_ = false;
+            chunked_ = false;
+            chunked_open_ = false;
+            chunk_buffer_.clear();
+            body_bytes_ = 0;
+        }
+
+        // Schließt eine geöffnete Datei, wenn die Coroutine endet
+        struct file_descriptor {
+            int fd;
+
+            ~file_descriptor() {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+        };
+
+        // Schreibt length Bytes ab offset aus der Datei fd auf das Socket. Unter
+        // Linux kopiert sendfile die Daten im Kernel direkt aus dem Page-Cache auf
+        // das Socket, sie passieren also keinen Puffer im Userspace. Ist das
+        // Socket voll, wartet die Coroutine, statt den Thread zu blockieren.
+        boost::asio::awaitable<void> async_write_file(int fd, std::uint64_t offset, std::uint64_t length) {
+#ifdef __linux__
+            if (!s_.native_non_blocking()) {
+                s_.native_non_blocking(true);
+            }
+            auto position = static_cast<off_t>(offset);
+            while (length > 0) {
+                auto sent = ::sendfile(
+                    s_.native_handle(), fd, &position, static_cast<std::size_t>(std::min(length, max_sendfile_size)));
+                if (sent > 0) {
+                    length -= static_cast<std::uint64_t>(sent);
+                    body_bytes_ += static_cast<std::uint64_t>(sent);
+                } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    co_await s_.async_wait(Socket::wait_write, boost::asio::use_awaitable);
+                } else if (sent < 0 && errno == EINTR) {
+                    continue;
+                } else {
+                    // Die Datei ist während des Sendens kürzer geworden
+                    throw std::system_error { sent < 0 ? errno : EIO, std::generic_category() };
+                }
+            }
+#else
+            std::string buffer(static_cast<std::size_t>(std::min<std::uint64_t>(length, 64 * 1024)), '\0');
+            while (length > 0) {
+                auto n = ::pread(fd, buffer.data(), static_cast<std::size_t>(std::min<std::uint64_t>(length, buffer.size())),
+                    static_cast<off_t>(offset));
+                if (n <= 0) {
+                    throw std::system_error { n < 0 ? errno : EIO, std::generic_category() };
+                }
+                co_await boost::asio::async_write(
+                    s_, boost::asio::buffer(buffer.data(), static_cast<std::size_t>(n)), boost::asio::use_awaitable);
+                offset += static_cast<std::uint64_t>(n);
+                length -= static_cast<std::uint64_t>(n);
+                body_bytes_ += static_cast<std::uint64_t>(n);
+            }
+#endif
+        }
+
+        boost::asio::awaitable<void> async_flush_chunk() {
+            co_await async_write_header();
+            if (chunk_buffer_.empty()) {
+                co_return;
+            }
+
+            if (chunked_) {
+                // Größe in Hex, Daten und abschließendes \r\n in einem Schreibvorgang
+                std::array<char, 2 * sizeof(std::size_t) + 2> size_line;
+                auto [end, ec] = std::to_chars(size_line.data(), size_line.data() + size_line.size() - 2,
+                    chunk_buffer_.size(), 16);
+                *end++ = '\r';
+                *end++ = '\n';
+                std::array<boost::asio::const_buffer, 3> bufs {
+                    boost::asio::buffer(size_line.data(), static_cast<std::size_t>(end - size_line.data())),
+                    boost::asio::buffer(chunk_buffer_),
+                    boost::asio::buffer(std::string_view { "\r\n" }),
+                };
+                co_await boost::asio::async_write(s_, bufs, boost::asio::use_awaitable);
+            } else {
+                co_await boost::asio::async_write(s_, boost::asio::buffer(chunk_buffer_), boost::asio::use_awaitable);
+            }
+            body_bytes_ += chunk_buffer_.size();
+            chunk_buffer_.clear();
+        }
+
+        boost::asio::awaitable<void> async_finish_chunked() {
+            if (!chunked_open_) {
+                co_return;
+            }
+            co_await async_flush_chunk();
+            chunked_open_ = false;
+            if (chunked_) {
+                co_await boost::asio::async_write(
+                    s_, boost::asio::buffer(std::string_view { "0\r\n\r\n" }), boost::asio::use_awaitable);
+            }
+        }
 
     public:
         res(Socket& s)
             : s_(s) { }
 
+        std::uint64_t bytes_sent() const noexcept {
+            return body_bytes_;
+        }
+
         boost::asio::awaitable<void> async_write_header() {
             if(!header_written_) {
-                co_await http::async_write_response(s_, *this, boost::asio::use_awaitable);
+                // Ohne Content-Length oder Transfer-Encoding endet der Body erst
+                // mit dem Schließen der Verbindung.
+                if (keep_alive_ && !has_framing()) {
+                    keep_alive_ = false;
+                }
+                fields["Connection"] = keep_alive_ ? "keep-alive" : "close";
+
+                auto [ec, written] = co_await http::async_write_response(s_, *this, boost::asio::use_awaitable);
+                if (ec) {
+                    throw std::system_error { ec };
+                }
                 header_written_ = true;
             }
         }
@@ -67,46 +567,219 @@ public:
             return [](res& self, Buffer&& buffer) mutable -> boost::asio::awaitable<std::size_t> {
                 co_await self.async_write_header();
                 auto written = co_await boost::asio::async_write(self.s_, std::forward<Buffer>(buffer), boost::asio::use_awaitable);
+                self.body_bytes_ += written;
                 co_return written;
             }(*this, std::forward<Buffer>(buffer));
         }
+
+        // Schickt die Datei unter path als Body. Fordert die Request mit Range
+        // einen einzelnen Bereich an, wird nur dieser mit 206 geschickt, ein
+        // Bereich hinter dem Dateiende wird mit 416 beantwortet. Ist ein ETag
+        // gesetzt, gilt Range nur, wenn If-Range dazu passt. Content-Type und
+        // weitere Felder setzt der Aufrufer vorher. Liefert false, falls die
+        // Datei nicht geöffnet werden kann, die Antwort ist dann unberührt.
+        boost::asio::awaitable<bool> async_send_file(const req& request, const std::string& path) {
+            file_descriptor file { ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+            struct stat info;
+            if (file.fd < 0 || ::fstat(file.fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+                co_return false;
+            }
+
+            auto size = static_cast<std::uint64_t>(info.st_size);
+            http::byte_range range { 0, size };
+            fields["Accept-Ranges"] = "bytes";
+
+            auto range_field = request.field("Range");
+            auto if_range = request.field("If-Range");
+            if (range_field && status_code == http::status_code::ok && (!if_range || if_range == field("ETag"))) {
+                bool unsatisfiable;
+                if (auto requested = http::parse_range(*range_field, size, unsatisfiable)) {
+                    range = *requested;
+                    status_code = http::status_code::partial_content;
+                    fields["Content-Range"] = "bytes " + std::to_string(range.first) + "-"
+                        + std::to_string(range.first + range.length - 1) + "/" + std::to_string(size);
+                } else if (unsatisfiable) {
+                    status_code = http::status_code::range_not_satisfiable;
+                    fields["Content-Range"] = "bytes */" + std::to_string(size);
+                    range.length = 0;
+                }
+            }
+
+            set_content_length(range.length);
+            co_await async_write_header();
+            co_await async_write_file(file.fd, range.first, range.length);
+            co_return true;
+        }
+
+        // Beginnt einen Body unbekannter Länge. Der Header wird erst mit dem
+        // ersten Chunk geschrieben, Status und Felder können bis dahin noch
+        // gesetzt werden. Vergisst der Handler async_finish(), beendet die
+        // Session den Body.
+        chunked_writer chunked(std::size_t flush_threshold = 16 * 1024) {
+            chunked_ = protocol == http::protocol::http11;
+            chunked_open_ = true;
+            if (chunked_) {
+                fields["Transfer-Encoding"] = "chunked";
+            }
+            return { *this, flush_threshold };
+        }
     };
 
-    using handler = std::function<boost::asio::awaitable<void>(res&, req&)>;
+    // Der Handler wird mit (res&, req&) aufgerufen und liefert ein awaitable<void>.
+    // Er wird pro Verbindung einmal kopiert und sollte deshalb klein sein.
+    template<typename Handler, typename CompletionToken>
+    static void co_spawn(Socket socket, Handler h, CompletionToken&& token) {
+        co_spawn(std::move(socket), std::move(h), options {}, std::forward<CompletionToken>(token));
+    }
 
-    template<typename CompletionToken>
-    static void co_spawn(Socket socket, handler h, CompletionToken&& token) {
-        boost::asio::co_spawn(socket.get_executor(), [socket = std::move(socket), h = std::move(h)]() mutable -> boost::asio::awaitable<void> {
-            // Request und Response Objekte anlegen
+    template<typename Handler, typename CompletionToken>
+    static void co_spawn(Socket socket, Handler h, options opts, CompletionToken&& token) {
+        boost::asio::co_spawn(socket.get_executor(), [socket = std::move(socket), h = std::move(h), opts]() mutable -> boost::asio::awaitable<void> {
+            // Request und Response Objekte werden für alle Requests der
+            // Verbindung wiederverwendet
             req req{socket};
             res res{socket};
+            idle_timer idle{socket};
+            req.idle_ = &idle;
+            req.read_timeout_ = opts.idle_timeout;
+
+            for (std::size_t served = 0; served < opts.max_requests; ++served) {
+                req.reset();
+                res.reset();
 
-            // Annahme der HTTP-Verbindung
-            try {
-                // 1. Schritt: Header lesen und parsen
-                co_await req.async_read_header();
+                // Annahme der HTTP-Request
+                try {
+                    // 1. Schritt: Header lesen und parsen. Kommt in idle_timeout
+                    // keine Request, wird die Verbindung geschlossen.
+                    idle.arm(opts.idle_timeout);
+                    co_await req.async_read_header();
+                    req.received = std::chrono::steady_clock::now();
+                    idle.disarm();
 
-                // 2. Schritt: Standardprotokoll bei der Antwort auf das Protokoll der Request setzen
-                res.protocol = req.protocol;
-            } catch(std::system_error& err) {
-                if(err.code() != http::make_error_code(http::error::malformed_request) && err.code() != http::make_error_code(http::error::malformed_field)) {
-                    throw err;
+                    // 2. Schritt: Standardprotokoll bei der Antwort auf das Protokoll der Request setzen
+                    res.protocol = req.protocol;
+                } catch(std::system_error& err) {
+                    idle.disarm();
+                    req.received = std::chrono::steady_clock::now();
+                    if(err.code() == http::make_error_code(http::error::header_too_large) || err.code() == http::make_error_code(http::error::too_many_fields)) {
+                        res.status_code = http::status_code::request_header_fields_too_large;
+                    } else if(err.code() == http::make_error_code(http::error::malformed_request) || err.code() == http::make_error_code(http::error::malformed_field)) {
+                        // Bei einer ungültigen Request eine Bad-Request antworten
+                        res.status_code = http::status_code::bad_request;
+                    } else {
+                        // Die Gegenseite hat die Verbindung geschlossen oder
+                        // sich zu lange nicht gemeldet
+                        co_return;
+                    }
+                }
+                if(res.status_code != http::status_code::ok) {
+                    co_await res.async_write_header();
+                    if (opts.on_complete) {
+                        opts.on_complete(res, req);
+                    }
+                    co_return;
+                }
+
+                // Die Verbindung bleibt offen, wenn der Client das möchte
+                res.keep_alive_ = req.keep_alive() && served + 1 < opts.max_requests;
+
+                // 3. Schritt: Weitergabe der Kontrolle an den Handler
+                co_await h(res, req);
+
+                // Der Client hat den Body zu langsam geschickt und das Socket
+                // wurde geschlossen, eine Antwort kommt nicht mehr an
+                if (!req.socket_taken_ && !socket.is_open()) {
+                    co_return;
+                }
+
+                // Das Socket gehört jetzt jemand anderem (z.B. einem WebSocket)
+                if (req.socket_taken_) {
+                    if (opts.on_complete) {
+                        opts.on_complete(res, req);
+                    }
+                    co_return;
+                }
+
+                // Der Body war zu groß oder fehlerhaft kodiert. Die Verbindung ist
+                // danach nicht mehr synchron und wird geschlossen.
+                if (req.body_error_) {
+                    if (!res.header_written_) {
+                        res.status_code = req.body_error_ == http::make_error_code(http::error::body_too_large)
+                            ? http::status_code::payload_too_large
+                            : http::status_code::bad_request;
+                    }
+                    res.keep_alive_ = false;
+                }
+
+                // Einen angefangenen, aber nicht beendeten chunked Body abschließen
+                co_await res.async_finish_chunked();
+
+                // 4. Schritt: Sicherstellen, dass überhaupt ein Antwortheader geschrieben wurde,
+                // falls der Handler das nicht bereits getan haben sollte.
+                if (!res.header_written_ && !res.has_framing()) {
+                    res.set_content_length(0);
                 }
-                // Bei einer ungültigen Request eine Bad-Request antworten
-                res.status_code = http::status_code::bad_request;
-            }
-            if(res.status_code == http::status_code::bad_request) {
                 co_await res.async_write_header();
-                co_return;
-            }
+                if (opts.on_complete) {
+                    opts.on_complete(res, req);
+                }
 
-            // 3. Schritt: Weitergabe der Kontrolle an den Handler
-            co_await h(res, req);
+                if (!res.keep_alive_) {
+                    co_return;
+                }
 
-            // 4. Schritt: Sicherstellen, dass überhaupt ein Antwortheader geschrieben wurde,
-            // falls der Handler das nicht bereits getan haben sollte.
-            co_await res.async_write_header();
+                // 5. Schritt: Den Rest des Bodys verwerfen, den der Handler nicht gelesen hat
+                try {
+                    if (!co_await req.async_skip_body(opts.max_skipped_body)) {
+                        co_return;
+                    }
+                } catch (std::exception&) {
+                    co_return;
+                }
+            }
         }, std::forward<CompletionToken>(token));
     }
+
+private:
+    // Schließt das Socket, wenn die Verbindung zu lange untätig ist. Der Timer
+    // wird für alle Requests der Verbindung wiederverwendet. Die Generation
+    // verhindert, dass ein bereits abgelaufener, aber noch nicht ausgeführter
+    // Handler eine spätere Runde trifft.
+    class idle_timer {
+        struct state {
+            boost::asio::steady_timer timer;
+            Socket* socket;
+            std::uint64_t generation { 0 };
+            bool armed { false };
+        };
+
+        std::shared_ptr<state> state_;
+
+    public:
+        idle_timer(Socket& socket)
+            : state_(std::make_shared<state>(state { boost::asio::steady_timer { socket.get_executor() }, &socket })) { }
+
+        ~idle_timer() {
+            state_->socket = nullptr;
+            state_->timer.cancel();
+        }
+
+        void arm(std::chrono::steady_clock::duration timeout) {
+            state_->armed = true;
+            state_->timer.expires_after(timeout);
+            state_->timer.async_wait([state = state_, generation = state_->generation](boost::system::error_code ec) {
+                if (!ec && state->armed && state->generation == generation && state->socket) {
+                    boost::system::error_code ignored;
+                    state->socket->close(ignored);
+                }
+            });
+        }
+
+        void disarm() {
+            state_->armed = false;
+            ++state_->generation;
+            state_->timer.cancel();
+        }
+    };
 };
 };
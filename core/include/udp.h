@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+#include <boost/asio.hpp>
+
+#include "log.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+namespace core::udp {
+
+// batch_receiver liest pro Bereitschaftsereignis des Sockets so viele
+// Datagramme wie möglich auf einmal. Unter Linux geschieht das mit einem
+// einzigen recvmmsg-Aufruf, der direkt in einen Satz vorab allokierter Slots
+// schreibt. Dadurch kostet ein Paket weder einen eigenen Systemaufruf noch eine
+// Heap-Allokation. Auf anderen Plattformen wird auf ein einzelnes
+// async_receive pro Durchlauf zurückgefallen.
+//
+// Die Slots werden bei jedem Aufruf von async_receive wiederverwendet, d.h. die
+// zurückgegebenen string_views sind nur bis zum nächsten Aufruf gültig.
+template <std::size_t BatchSize, std::size_t SlotSize> class batch_receiver {
+    static_assert(BatchSize > 0, "BatchSize muss größer als 0 sein");
+
+    std::array<std::array<char, SlotSize>, BatchSize> slots_;
+    std::array<std::size_t, BatchSize> lengths_ {};
+    std::size_t count_ { 0 };
+
+#if defined(__linux__)
+    std::array<iovec, BatchSize> iovecs_;
+    std::array<mmsghdr, BatchSize> headers_;
+#endif
+
+public:
+    static constexpr std::size_t batch_size = BatchSize;
+    static constexpr std::size_t slot_size = SlotSize;
+
+    batch_receiver() {
+#if defined(__linux__)
+        // Die Zeiger in den Headern bleiben über die gesamte Lebensdauer gleich,
+        // deshalb können sie hier einmalig gesetzt werden.
+        for (std::size_t i = 0; i < BatchSize; ++i) {
+            iovecs_[i].iov_base = slots_[i].data();
+            iovecs_[i].iov_len = SlotSize;
+            headers_[i] = mmsghdr {};
+            headers_[i].msg_hdr.msg_iov = &iovecs_[i];
+            headers_[i].msg_hdr.msg_iovlen = 1;
+        }
+#endif
+    }
+
+    // batch_receiver ist wegen der internen Zeiger weder kopier- noch verschiebbar
+    batch_receiver(const batch_receiver&) = delete;
+    batch_receiver& operator=(const batch_receiver&) = delete;
+
+    std::size_t size() const noexcept {
+        return count_;
+    }
+
+    std::string_view operator[](std::size_t i) const noexcept {
+        return { slots_[i].data(), lengths_[i] };
+    }
+
+    // Wartet, bis mindestens ein Datagramm vorliegt, und liest dann alle bereits
+    // eingetroffenen Datagramme (höchstens BatchSize). Gibt die Anzahl zurück.
+    template <typename Socket> boost::asio::awaitable<std::size_t> async_receive(Socket& socket) {
+        count_ = 0;
+#if defined(__linux__)
+        for (;;) {
+            co_await socket.async_wait(Socket::wait_read, boost::asio::use_awaitable);
+
+            auto received = ::recvmmsg(socket.native_handle(), headers_.data(), BatchSize, MSG_DONTWAIT, nullptr);
+            if (received < 0) {
+                // Andere Fehler (z.B. ENOMEM oder ein per ICMP gemeldetes
+                // ECONNREFUSED) betreffen nur diesen Aufruf und dürfen den
+                // Empfang des Sockets nicht dauerhaft beenden.
+                auto error = errno;
+                if (error != EAGAIN && error != EWOULDBLOCK && error != EINTR) {
+                    log::warning("Beim Empfangen von UDP-Datagrammen ist ein Fehler aufgetreten")
+                        .field("error", std::strerror(error));
+                }
+                continue;
+            }
+
+            for (int i = 0; i < received; ++i) {
+                // Abgeschnittene Datagramme passen nicht in einen Slot und sind
+                // damit ohnehin nicht dekodierbar.
+                if (headers_[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                    continue;
+                }
+                lengths_[count_] = headers_[i].msg_len;
+                if (count_ != static_cast<std::size_t>(i)) {
+                    std::copy_n(slots_[i].data(), headers_[i].msg_len, slots_[count_].data());
+                }
+                ++count_;
+            }
+
+            if (count_ > 0) {
+                co_return count_;
+            }
+        }
+#else
+        lengths_[0] = co_await socket.async_receive(boost::asio::buffer(slots_[0]), boost::asio::use_awaitable);
+        count_ = 1;
+        co_return count_;
+#endif
+    }
+};
+
+}
@@ -4,17 +4,19 @@ class Application {
         this._totalConsumptionPower = 0;
         this._map = document.getElementById('map');
         this._dots = new Map();
+        this._prosumers = new Map();
+        this._seq = null;
 
         this._openSocket();
         this._initChart();
     }
 
     _openSocket() {
-        this._socket = new WebSocket(`ws://${location.host}/ws`);
+        this._socket = new WebSocket(`ws://${location.host}/ws?protocol=delta`);
         this._socket.addEventListener('message', message => {
             try {
-                const prosumers = JSON.parse(message.data);
-                this._processMessage(prosumers);
+                const data = JSON.parse(message.data);
+                this._processMessage(data);
             } catch (err) {
                 console.error(err);
             }
@@ -97,27 +99,73 @@ class Application {
         this._chart.render();
     }
 
-    _processMessage(prosumers) {
-        const allNotifications = Object.entries(prosumers).map(([_, notification]) => notification);
-        this._totalProductionPower = allNotifications.filter(notif => notif.type === 0).reduce((acc, cur) => acc + cur.power, 0);
-        this._totalConsumptionPower = allNotifications.filter(notif => notif.type === 1).reduce((acc, cur) => acc + cur.power, 0);
+    _processMessage(data) {
+        if (data.type === 'snapshot') {
+            // Vollständiger Zustand: alles Bisherige verwerfen
+            this._seq = data.seq;
+            this._prosumers = new Map(Object.entries(data.prosumers));
+            for (const prosumerID of this._dots.keys()) {
+                if (!this._prosumers.has(prosumerID)) {
+                    this._removeDot(prosumerID);
+                }
+            }
+            for (const prosumerID of this._prosumers.keys()) {
+                this._updateDot(prosumerID);
+            }
+        } else if (data.type === 'delta') {
+            if (this._seq === null) {
+                // Noch kein Snapshot erhalten
+                return;
+            }
+            if (data.seq !== this._seq + 1) {
+                // Es fehlen Deltas, also einen neuen Snapshot anfordern
+                this._seq = null;
+                this._socket.send(JSON.stringify({ type: 'resync' }));
+                return;
+            }
+            this._seq = data.seq;
 
-        const prosumerIDs = Object.keys(prosumers);
-        for(const prosumerID of prosumerIDs) {
-            if(!this._dots.has(prosumerID)) {
-                this._dots.set(prosumerID, new MapDot(this._map));
+            for (const prosumerID of data.removed) {
+                this._prosumers.delete(prosumerID);
+                this._removeDot(prosumerID);
+            }
+            for (const [prosumerID, prosumer] of Object.entries(data.added)) {
+                this._prosumers.set(prosumerID, prosumer);
+                this._updateDot(prosumerID);
             }
+            for (const [prosumerID, fields] of Object.entries(data.updated)) {
+                const prosumer = this._prosumers.get(prosumerID);
+                if (prosumer === undefined) {
+                    continue;
+                }
+                Object.assign(prosumer, fields);
+                if ('pos_x' in fields) {
+                    this._updateDot(prosumerID);
+                }
+            }
+        } else {
+            return;
+        }
 
-            const dot = this._dots.get(prosumerID);
-            dot.setPosition(prosumers[prosumerID].pos_x, prosumers[prosumerID].pos_y);
+        const allNotifications = Array.from(this._prosumers.values());
+        this._totalProductionPower = allNotifications.filter(notif => notif.type === 0).reduce((acc, cur) => acc + cur.power, 0);
+        this._totalConsumptionPower = allNotifications.filter(notif => notif.type === 1).reduce((acc, cur) => acc + cur.power, 0);
+    }
+
+    _updateDot(prosumerID) {
+        if (!this._dots.has(prosumerID)) {
+            this._dots.set(prosumerID, new MapDot(this._map));
         }
-        for(const prosumerID of this._dots.keys()) {
-            // Prüfe, ob sich ein Prosumer verabschiedet hat.
-            if(!prosumerIDs.includes(prosumerID)) {
-                const dot = this._dots.get(prosumerID);
-                dot.delete();
-                this._dots.delete(prosumerID);
-            }
+        const prosumer = this._prosumers.get(prosumerID);
+        this._dots.get(prosumerID).setPosition(prosumer.pos_x, prosumer.pos_y);
+    }
+
+    _removeDot(prosumerID) {
+        // Prüfe, ob sich ein Prosumer verabschiedet hat.
+        const dot = this._dots.get(prosumerID);
+        if (dot !== undefined) {
+            dot.delete();
+            this._dots.delete(prosumerID);
         }
     }
 
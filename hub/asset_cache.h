@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <filesystem.hpp>
+#include <zlib.h>
+#ifdef HUB_WITH_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#include "http.h"
+#include "log.h"
+
+// asset_cache hält die Dateien des Frontends im Speicher. Jede Datei wird einmal
+// gelesen und, wo es sich lohnt, vorab mit gzip (und Brotli, falls verfügbar)
+// komprimiert. Zu jeder Variante gibt es einen starken ETag aus dem Hash des
+// Inhalts. Dateien über max_cached_size werden nur vermerkt und bei jeder
+// Request per sendfile direkt von der Platte geschickt. Ihr ETag ergibt sich aus
+// Größe und Änderungszeit.
+//
+// Der Cache selbst ist unveränderlich. refresh() vergleicht Änderungszeit und
+// Größe der Dateien und tauscht bei Änderungen die ganze Tabelle atomar aus.
+// Requests greifen deshalb ohne Lock und ohne Dateizugriff auf die Tabelle zu,
+// und eine Antwort hält ihr Asset über den shared_ptr am Leben, auch wenn
+// währenddessen neu geladen wird.
+//
+// refresh() darf auf einem anderen Thread laufen als find(), aber nie auf
+// mehreren gleichzeitig.
+class asset_cache {
+public:
+    struct variant {
+        std::string_view encoding {};
+        std::string etag {};
+        std::string body {};
+    };
+
+    struct asset {
+        std::string_view content_type;
+        std::string_view cache_control;
+        ghc::filesystem::file_time_type mtime;
+        std::uintmax_t size;
+        variant identity;
+        std::optional<variant> gzip {};
+        std::optional<variant> brotli {};
+
+        // Pfad der Datei, falls ihr Inhalt nicht im Speicher liegt
+        std::string file {};
+
+        // Wählt die kleinste Variante, die der Client laut Accept-Encoding versteht
+        const variant& select(std::optional<std::string_view> accept_encoding) const {
+            if (accept_encoding) {
+                if (brotli && accepts(*accept_encoding, "br")) {
+                    return *brotli;
+                }
+                if (gzip && accepts(*accept_encoding, "gzip")) {
+                    return *gzip;
+                }
+            }
+            return identity;
+        }
+    };
+
+private:
+    // Nach Pfad sortiert, damit ohne Kopie des Pfads binär gesucht werden kann
+    using table = std::vector<std::pair<std::string, std::shared_ptr<const asset>>>;
+
+    // Komprimierte Varianten werden nur behalten, wenn sie mindestens so viel kleiner sind
+    static constexpr double min_compression_ratio = 0.9;
+
+    ghc::filesystem::path root_;
+    std::uintmax_t max_cached_size_;
+    std::shared_ptr<const table> table_ { std::make_shared<table>() };
+
+public:
+    asset_cache(ghc::filesystem::path root, std::uintmax_t max_cached_size)
+        : root_(std::move(root))
+        , max_cached_size_(max_cached_size) {
+        refresh();
+    }
+
+    // Sucht das Asset zu einem bereits normalisierten Pfad wie /js/index.js
+    std::shared_ptr<const asset> find(std::string_view path) const {
+        auto t = std::atomic_load(&table_);
+        auto it = std::lower_bound(t->begin(), t->end(), path,
+            [](const auto& entry, std::string_view path) { return entry.first < path; });
+        if (it == t->end() || it->first != path) {
+            return nullptr;
+        }
+        return it->second;
+    }
+
+    // Lädt neue und geänderte Dateien und entfernt gelöschte. Unveränderte
+    // Dateien werden aus der alten Tabelle übernommen. Liefert true, falls sich
+    // etwas geändert hat.
+    bool refresh() {
+        auto old = std::atomic_load(&table_);
+        auto next = std::make_shared<table>();
+        bool changed = false;
+
+        std::error_code ec;
+        for (ghc::filesystem::recursive_directory_iterator it { root_, ec }, end; !ec && it != end; it.increment(ec)) {
+            if (!it->is_regular_file(ec)) {
+                continue;
+            }
+            auto path = "/" + ghc::filesystem::relative(it->path(), root_, ec).generic_string();
+            auto mtime = it->last_write_time(ec);
+            auto size = it->file_size(ec);
+            if (ec) {
+                continue;
+            }
+
+            auto previous = std::lower_bound(old->begin(), old->end(), path,
+                [](const auto& entry, const std::string& path) { return entry.first < path; });
+            if (previous != old->end() && previous->first == path && previous->second->mtime == mtime
+                && previous->second->size == size) {
+                next->emplace_back(std::move(path), previous->second);
+                continue;
+            }
+
+            if (auto loaded = load(it->path(), mtime, size)) {
+                next->emplace_back(std::move(path), std::move(loaded));
+                changed = true;
+            }
+        }
+        if (ec) {
+            core::log::error("Das Frontend konnte nicht gelesen werden")
+                .field("path", root_.string())
+                .field("error", ec.message());
+        }
+
+        std::sort(next->begin(), next->end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        changed = changed || next->size() != old->size();
+        if (changed) {
+            std::atomic_store(&table_, std::shared_ptr<const table> { std::move(next) });
+        }
+        return changed;
+    }
+
+    // Ob eine der in If-None-Match genannten Versionen zum ETag passt. Der
+    // Vergleich ist schwach (RFC 7232, Abschnitt 3.2), W/ wird also ignoriert.
+    static bool matches(std::string_view if_none_match, std::string_view etag) {
+        while (!if_none_match.empty()) {
+            auto comma = if_none_match.find(',');
+            auto item = trim(if_none_match.substr(0, comma));
+            if (item.starts_with("W/")) {
+                item.remove_prefix(2);
+            }
+            if (item == "*" || item == etag) {
+                return true;
+            }
+            if (comma == if_none_match.npos) {
+                break;
+            }
+            if_none_match.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+
+    static std::string_view content_type_of(const ghc::filesystem::path& path) {
+        static constexpr std::pair<std::string_view, std::string_view> types[] = {
+            { ".css", "text/css; charset=utf-8" },
+            { ".html", "text/html; charset=utf-8" },
+            { ".js", "application/javascript; charset=utf-8" },
+            { ".json", "application/json" },
+            { ".md", "text/markdown; charset=utf-8" },
+            { ".pdf", "application/pdf" },
+            { ".png", "image/png" },
+            { ".svg", "image/svg+xml; charset=utf-8" },
+        };
+        auto extension = path.extension().string();
+        for (auto [ext, type] : types) {
+            if (extension == ext) {
+                return type;
+            }
+        }
+        return "text/plain; charset=utf-8";
+    }
+
+private:
+    static std::string_view trim(std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+            s.remove_prefix(1);
+        }
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+            s.remove_suffix(1);
+        }
+        return s;
+    }
+
+    // Ob coding in Accept-Encoding vorkommt und nicht mit q=0 ausgeschlossen ist
+    static bool accepts(std::string_view accept_encoding, std::string_view coding) {
+        while (!accept_encoding.empty()) {
+            auto comma = accept_encoding.find(',');
+            auto item = accept_encoding.substr(0, comma);
+            auto semicolon = item.find(';');
+            auto name = trim(item.substr(0, semicolon));
+
+            if (core::http::internal::iequals(name, coding)) {
+                if (semicolon == item.npos) {
+                    return true;
+                }
+                auto params = trim(item.substr(semicolon + 1));
+                return !(params.starts_with("q=0") && params.find_first_of("123456789") == params.npos);
+            }
+            if (comma == accept_encoding.npos) {
+                break;
+            }
+            accept_encoding.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+
+    // Starker ETag aus dem FNV-1a-Hash des Inhalts, ergänzt um die Kodierung
+    static std::string etag_of(std::string_view body, std::string_view suffix) {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : body) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        char buf[24];
+        auto len = std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+        std::string etag { "\"" };
+        etag.append(buf, static_cast<std::size_t>(len));
+        etag += suffix;
+        etag += '"';
+        return etag;
+    }
+
+    static std::optional<std::string> gzip(std::string_view input) {
+        z_stream stream {};
+        // 15 Bit Fenster, +16 für einen gzip- statt zlib-Header
+        if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return std::nullopt;
+        }
+        std::string output(deflateBound(&stream, static_cast<uLong>(input.size())), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        stream.avail_in = static_cast<uInt>(input.size());
+        stream.next_out = reinterpret_cast<Bytef*>(output.data());
+        stream.avail_out = static_cast<uInt>(output.size());
+
+        auto result = deflate(&stream, Z_FINISH);
+        output.resize(stream.total_out);
+        deflateEnd(&stream);
+        if (result != Z_STREAM_END) {
+            return std::nullopt;
+        }
+        return output;
+    }
+
+#ifdef HUB_WITH_BROTLI
+    static std::optional<std::string> brotli(std::string_view input) {
+        std::string output(BrotliEncoderMaxCompressedSize(input.size()), '\0');
+        auto size = output.size();
+        if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC, input.size(),
+                reinterpret_cast<const std::uint8_t*>(input.data()), &size,
+                reinterpret_cast<std::uint8_t*>(output.data()))) {
+            return std::nullopt;
+        }
+        output.resize(size);
+        return output;
+    }
+#endif
+
+    static std::optional<variant> compressed(
+        const std::string& identity, std::optional<std::string> body, std::string_view encoding, std::string_view suffix) {
+        if (!body || body->size() > identity.size() * min_compression_ratio) {
+            return std::nullopt;
+        }
+        auto etag = etag_of(identity, suffix);
+        return variant { encoding, std::move(etag), std::move(*body) };
+    }
+
+    std::shared_ptr<const asset> load(
+        const ghc::filesystem::path& path, ghc::filesystem::file_time_type mtime, std::uintmax_t size) const {
+        // Die Startseite wird immer neu validiert, damit Änderungen am Frontend
+        // sofort ankommen. Alles andere darf der Browser kurz zwischenspeichern.
+        auto content_type = content_type_of(path);
+        std::string_view cache_control
+            = path.extension() == ".html" ? "no-cache" : "public, max-age=300";
+
+        if (size > max_cached_size_) {
+            char etag[48];
+            auto len = std::snprintf(etag, sizeof(etag), "\"%llx-%llx\"", static_cast<unsigned long long>(size),
+                static_cast<unsigned long long>(mtime.time_since_epoch().count()));
+            auto result = std::make_shared<asset>(asset {
+                content_type,
+                cache_control,
+                mtime,
+                size,
+                variant { {}, std::string { etag, static_cast<std::size_t>(len) }, {} },
+            });
+            result->file = path.string();
+            return result;
+        }
+
+        std::ifstream input { path, std::ios::binary };
+        if (!input) {
+            return nullptr;
+        }
+        std::string body { std::istreambuf_iterator<char>(input), {} };
+
+        auto result = std::make_shared<asset>(asset {
+            content_type,
+            cache_control,
+            mtime,
+            size,
+            variant { {}, etag_of(body, {}), {} },
+        });
+        result->gzip = compressed(body, gzip(body), "gzip", "-gz");
+#ifdef HUB_WITH_BROTLI
+        result->brotli = compressed(body, brotli(body), "br", "-br");
+#endif
+        result->identity.body = std::move(body);
+        return result;
+    }
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <variant>
+#include <vector>
+
+#include "models.h"
+
+// history speichert die letzten Capacity Messwerte eines Prosumers in einem
+// Ringpuffer. Die Werte liegen spaltenweise (structure of arrays) in
+// zusammenhängendem Speicher: Leistung und Zeitstempel in je einem Array fester
+// Größe. Alles, was sich zwischen zwei Messwerten normalerweise nicht ändert
+// (ID, Typ, Position), wird nicht pro Messwert abgelegt. Die ID verwaltet der
+// Aufrufer, der Typ wird einmal gespeichert, und die Position nur dann, wenn sie
+// sich tatsächlich ändert.
+//
+// Das Einfügen eines Messwertes allokiert keinen Speicher, solange sich die
+// Position nicht häufiger ändert als bisher.
+template <std::size_t Capacity> class history {
+public:
+    // Ein einzelner Messwert, wie er aus dem Ringpuffer gelesen wird
+    struct sample {
+        std::uint64_t power;
+        std::int64_t timestamp;
+        double pos_x;
+        double pos_y;
+    };
+
+private:
+    // Position ab dem Messwert mit der laufenden Nummer since
+    struct position {
+        std::uint64_t since;
+        double x;
+        double y;
+    };
+
+    std::array<std::uint64_t, Capacity> power_;
+    std::array<std::int64_t, Capacity> timestamp_;
+
+    // Anzahl aller jemals eingefügten Messwerte. Der Messwert mit der laufenden
+    // Nummer n liegt an Index n % Capacity.
+    std::uint64_t count_ { 0 };
+
+    // Nach since sortierte Positionswechsel. Es werden nur so viele vorgehalten,
+    // wie für die Messwerte im Puffer nötig sind.
+    std::vector<position> positions_ {};
+
+    std::variant<core::producer_type, core::consumer_type> type_ {};
+
+    std::uint64_t first() const noexcept {
+        return count_ - size();
+    }
+
+    // Entfernt Positionswechsel, die von keinem Messwert im Puffer mehr benötigt werden
+    void prune_positions() {
+        auto oldest = first();
+        auto it = positions_.begin();
+        while (std::next(it) != positions_.end() && std::next(it)->since <= oldest) {
+            ++it;
+        }
+        positions_.erase(positions_.begin(), it);
+    }
+
+public:
+    std::size_t size() const noexcept {
+        return static_cast<std::size_t>(std::min<std::uint64_t>(count_, Capacity));
+    }
+
+    bool empty() const noexcept {
+        return count_ == 0;
+    }
+
+    const std::variant<core::producer_type, core::consumer_type>& type() const noexcept {
+        return type_;
+    }
+
+    void push(const core::notification& notification) {
+        auto index = count_ % Capacity;
+        power_[index] = notification.power;
+        timestamp_[index] = notification.timestamp;
+        type_ = notification.type;
+
+        if (positions_.empty() || positions_.back().x != notification.pos_x
+            || positions_.back().y != notification.pos_y) {
+            positions_.push_back({ count_, notification.pos_x, notification.pos_y });
+        }
+        ++count_;
+
+        if (positions_.size() > 1) {
+            prune_positions();
+        }
+    }
+
+    sample back() const noexcept {
+        auto index = (count_ - 1) % Capacity;
+        const auto& pos = positions_.back();
+        return { power_[index], timestamp_[index], pos.x, pos.y };
+    }
+
+    // Ruft f(sample) für alle Messwerte vom ältesten zum neuesten auf
+    template <typename F> void for_each(F&& f) const {
+        auto pos = positions_.begin();
+        for (auto n = first(); n < count_; ++n) {
+            while (std::next(pos) != positions_.end() && std::next(pos)->since <= n) {
+                ++pos;
+            }
+            auto index = n % Capacity;
+            f(sample { power_[index], timestamp_[index], pos->x, pos->y });
+        }
+    }
+};
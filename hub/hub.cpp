@@ -1,25 +1,36 @@
 #include <algorithm>
+#include <array>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <exception>
-#include <fstream>
 #include <functional>
 #include <iostream>
 #include <iterator>
-#include <list>
 #include <map>
+#include <memory>
+#include <optional>
+#include <span>
 #include <sstream>
 #include <string_view>
 #include <system_error>
 #include <thread>
-#include <unordered_map>
+#include <tuple>
 
+#include "asset_cache.h"
 #include "http.h"
+#include "log.h"
+#include "metrics.h"
 #include "models.h"
 #include "router.h"
+#include "shard.h"
+#include "udp.h"
+#include "ws_client.h"
 
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
+#include <cxxopts.hpp>
 #include <filesystem.hpp>
 
 using namespace boost::asio;
@@ -36,134 +47,686 @@ static constexpr auto log_exception = [](std::exception_ptr eptr) {
     if (eptr) {
         try {
             std::rethrow_exception(eptr);
-        } catch (std::exception& err) { std::cerr << "Ein Fehler trat auf: " << err.what() << std::endl; } catch (...) {
-            std::cerr << "Ein unbekannter Fehler trat auf" << std::endl;
+        } catch (std::exception& err) {
+            core::log::error("Ein Fehler trat auf").field("error", err.what());
+        } catch (...) {
+            core::log::error("Ein unbekannter Fehler trat auf");
         }
     }
 };
 
-static constexpr auto logging_middleware = [](auto& res, auto& req, auto next) -> awaitable<void> {
-    std::cout << "Eingehende Request an " << req.url << std::endl;
-    co_await next();
-    std::cout << "Ausgehende Response mit " << static_cast<int>(res.status_code) << std::endl;
+// Ein Eintrag im Access-Log pro beantworteter Request. Erfolgreiche Requests
+// werden nur stichprobenartig geloggt (--log-sample), Fehler immer.
+static constexpr auto log_access = [](auto& res, auto& req) {
+    auto status = static_cast<unsigned int>(res.status_code);
+    if (status < 400 && !core::log::sample()) {
+        return;
+    }
+    auto latency = std::chrono::steady_clock::now() - req.received;
+    core::log::info("request")
+        .field("method", core::http::to_string(req.verb))
+        .field("path", req.path())
+        .field("route", req.route.empty() ? std::string_view { "-" } : req.route)
+        .field("status", status)
+        .field("bytes", res.bytes_sent())
+        .field("latency_us", std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+};
+
+// Anzahl der Datagramme, die pro Systemaufruf gelesen werden, und die maximale
+// Größe eines einzelnen Datagramms. Stapel der Prosumer füllen eine Ethernet-MTU
+// aus, ein Slot muss also mindestens 1472 Bytes fassen.
+static constexpr std::size_t udp_batch_size = 64;
+static constexpr std::size_t udp_slot_size = 2048;
+
+// Maskiert einen Wert für CSV, falls er Trennzeichen, Anführungszeichen oder
+// Zeilenumbrüche enthält
+static std::string csv_field(std::string_view value) {
+    if (value.find_first_of(",\"\r\n") == value.npos) {
+        return std::string { value };
+    }
+    std::string quoted { "\"" };
+    for (auto c : value) {
+        if (c == '"') {
+            quoted += '"';
+        }
+        quoted += c;
+    }
+    quoted += '"';
+    return quoted;
+}
+
+// Hängt eine Gleitkommazahl in der kürzesten Darstellung an, die beim
+// Zurücklesen wieder denselben Wert ergibt
+static void append_csv_number(std::string& out, double value) {
+    char buf[32];
+    auto length = std::snprintf(buf, sizeof(buf), "%.15g", value);
+    if (std::strtod(buf, nullptr) != value) {
+        length = std::snprintf(buf, sizeof(buf), "%.17g", value);
+    }
+    out.append(buf, static_cast<std::size_t>(length));
+}
+
+// Größe der Stapel, in denen per HTTP hochgeladene Benachrichtigungen an die
+// Shards gehen, und die maximale Länge einer Zeile
+static constexpr std::size_t bulk_batch_size = 256;
+static constexpr std::size_t bulk_max_line = 4096;
+
+// Metriken des Hubs, die nicht pro Route oder pro Shard anfallen. Alle Zähler
+// werden beim Start angelegt, auf dem heißen Pfad wird nur noch addiert.
+struct hub_metrics {
+    core::metrics::registry registry {};
+
+    core::metrics::counter& udp_received
+        = registry.add_counter("hub_udp_datagrams_received_total", "Empfangene UDP-Datagramme");
+    core::metrics::counter& udp_decoded
+        = registry.add_counter("hub_udp_datagrams_decoded_total", "Gültige UDP-Datagramme");
+    core::metrics::counter& udp_rejected
+        = registry.add_counter("hub_udp_datagrams_rejected_total", "Verworfene ungültige UDP-Datagramme");
+    core::metrics::counter& udp_notifications
+        = registry.add_counter("hub_udp_notifications_total", "Benachrichtigungen aus gültigen UDP-Datagrammen");
+    core::metrics::histogram& ingest_duration = registry.add_histogram("hub_ingest_batch_duration_seconds",
+        "Dauer für das Dekodieren und Verteilen eines Stapels von Datagrammen");
+
+    core::metrics::counter& broadcasts
+        = registry.add_counter("hub_broadcasts_total", "Broadcasts an die WebSocket-Clients");
+    core::metrics::histogram& broadcast_duration = registry.add_histogram(
+        "hub_broadcast_duration_seconds", "Dauer eines Broadcasts vom Einsammeln bis zum Einreihen der Nachrichten");
+    core::metrics::counter& broadcast_bytes
+        = registry.add_counter("hub_broadcast_bytes_total", "An WebSocket-Clients eingereihte Bytes");
+    core::metrics::gauge& websocket_clients
+        = registry.add_gauge("hub_websocket_clients", "Verbundene WebSocket-Clients beim letzten Broadcast");
+    core::metrics::gauge& websocket_queued = registry.add_gauge(
+        "hub_websocket_queued_messages", "Wartende Nachrichten aller WebSocket-Clients beim letzten Broadcast");
+};
+
+// Metriken pro Route und Verb: Anzahl nach Statusklasse (2xx bis 5xx), Dauer und Bytes.
+// Requests ohne passende Route zählen unter route="-". Die Tabelle wird nach
+// dem Registrieren der Routen einmal aufgebaut und danach nur noch gelesen.
+class http_metrics {
+    static constexpr std::size_t verb_count = 5;
+
+    struct route {
+        std::string_view pattern;
+        core::http::verb verb;
+        std::array<core::metrics::counter*, 4> requests;
+        core::metrics::histogram* duration;
+        core::metrics::counter* bytes;
+    };
+
+    core::metrics::registry& registry_;
+    std::vector<route> routes_ {};
+    std::vector<route> unmatched_ {};
+
+    route make_route(std::string_view pattern, core::http::verb verb) {
+        std::string labels = "route=\"" + core::metrics::label_value(pattern) + "\",method=\""
+            + std::string { core::http::to_string(verb) } + '"';
+        route r { pattern, verb, {}, nullptr, nullptr };
+        for (std::size_t i = 0; i < r.requests.size(); ++i) {
+            r.requests[i] = &registry_.add_counter("hub_http_requests_total", "Beantwortete HTTP-Requests",
+                labels + ",code=\"" + std::to_string(i + 2) + "xx\"");
+        }
+        r.duration = &registry_.add_histogram("hub_http_request_duration_seconds",
+            "Dauer vom Eingang des Headers bis zum Ende der Response", labels);
+        r.bytes = &registry_.add_counter("hub_http_response_bytes_total", "Gesendete Bytes im Body", labels);
+        return r;
+    }
+
+public:
+    explicit http_metrics(core::metrics::registry& registry)
+        : registry_(registry) { }
+
+    // Muss nach dem Registrieren aller Routen und vor der ersten Request aufgerufen werden
+    void add_routes(std::vector<std::pair<core::http::verb, std::string_view>> routes) {
+        for (auto [verb, pattern] : routes) {
+            routes_.push_back(make_route(pattern, verb));
+        }
+        std::sort(routes_.begin(), routes_.end(), [](const route& a, const route& b) {
+            return std::tie(a.pattern, a.verb) < std::tie(b.pattern, b.verb);
+        });
+        for (std::size_t verb = 0; verb < verb_count; ++verb) {
+            unmatched_.push_back(make_route("-", static_cast<core::http::verb>(verb)));
+        }
+    }
+
+    template <typename Res, typename Req> void observe(const Res& res, const Req& req) {
+        auto* r = &unmatched_[static_cast<std::size_t>(req.verb)];
+        auto it = std::lower_bound(routes_.begin(), routes_.end(), std::tie(req.route, req.verb),
+            [](const route& r, const auto& key) { return std::tie(r.pattern, r.verb) < key; });
+        if (it != routes_.end() && it->pattern == req.route && it->verb == req.verb) {
+            r = &*it;
+        }
+
+        auto status = static_cast<std::size_t>(res.status_code);
+        r->requests[std::clamp<std::size_t>(status / 100, 2, 5) - 2]->add();
+        r->duration->observe(std::chrono::steady_clock::now() - req.received);
+        r->bytes->add(res.bytes_sent());
+    }
 };
 
+// state verbindet die Shards mit den WebSocket-Clients. Die Liste der Clients
+// und der Broadcast laufen auf einem eigenen Strand.
 struct state {
-    // Wir speichern die letzten 120 Einträge
-    static constexpr std::size_t history_size = 120;
-
-    std::unordered_map<std::string, std::list<core::notification>> prosumers{};
-    std::unordered_map<std::string, steady_timer> prosumer_timers;
-    std::vector<websocket::stream<tcp::socket>> websockets{};
-
-    awaitable<void> update_prosumer(core::notification notification) {
-        auto not_exist = !prosumers.contains(notification.id);
-        if (not_exist || prosumers[notification.id].back().timestamp < notification.timestamp) {
-            if(prosumers[notification.id].size() == history_size) {
-                prosumers[notification.id].pop_front();
+    std::vector<std::unique_ptr<shard>> shards{};
+    std::vector<std::shared_ptr<ws_client>> websockets{};
+
+    // Grenzen für die Sendewarteschlangen der WebSockets
+    ws_client::limits ws_limits{ 16, std::chrono::seconds { 5 } };
+
+    strand<io_context::executor_type> broadcast_strand;
+
+    hub_metrics metrics {};
+
+    state(io_context& web_ctx, std::size_t num_shards, shard::liveness liveness)
+        : broadcast_strand(make_strand(web_ctx)) {
+        for (std::size_t i = 0; i < num_shards; ++i) {
+            shards.emplace_back(std::make_unique<shard>(liveness));
+            outboxes.emplace_back(num_shards);
+        }
+    }
+
+    // Welcher Shard zuständig ist, ergibt sich aus dem Hash der ID. Die Tabelle
+    // im Shard verteilt mit demselben Hash auf ihre Buckets, bei libc++ über
+    // die unteren Bits. Deshalb werden die Bits hier erst durchmischt, sonst
+    // bliebe in jedem Shard ein Teil der Buckets leer.
+    std::size_t shard_index(std::size_t hash) const {
+        return static_cast<std::size_t>((static_cast<std::uint64_t>(hash) * 0x9e3779b97f4a7c15ull) >> 32)
+            % shards.size();
+    }
+
+    shard& owner(const std::string& id) {
+        return *shards[shard_index(hashed_id { id }.hash)];
+    }
+
+    // Puffer eines Shard-Threads zum Verteilen. Ein Stapel für einen fremden
+    // Shard wird an dessen Thread übergeben und kommt geleert in spare zurück,
+    // damit seine Kapazität beim nächsten Mal wiederverwendet wird.
+    struct outbox {
+        std::vector<shard::batch> forward;
+        std::vector<shard::batch> spare {};
+        std::vector<std::size_t> hashes {};
+
+        explicit outbox(std::size_t num_shards)
+            : forward(num_shards) { }
+    };
+    std::vector<outbox> outboxes {};
+
+    // Verteilt einen Stapel, der auf dem Thread des Shards local empfangen wurde,
+    // auf die zuständigen Shards. Eigene Benachrichtigungen werden sofort
+    // verarbeitet, fremde pro Ziel-Shard gesammelt und in einem Rutsch an dessen
+    // Thread übergeben. Jede ID wird dabei genau einmal gehasht, der Hash
+    // wählt den Shard und dient dort auch für die Suche in der slot_table.
+    void dispatch(std::size_t local, std::span<core::notification> notifications) {
+        dispatch(local, outboxes[local], notifications);
+    }
+
+    // Verteilt Benachrichtigungen, die nicht auf dem Thread eines Shards
+    // empfangen wurden, z.B. per HTTP
+    void ingest(std::span<core::notification> notifications) {
+        outbox out { shards.size() };
+        dispatch(shards.size(), out, notifications);
+    }
+
+    void handle_websocket(websocket::stream<tcp::socket> ws, bool delta) {
+        auto client = std::make_shared<ws_client>(std::move(ws), delta, ws_limits);
+        client->start();
+        post(broadcast_strand, [this, client = std::move(client)]() mutable {
+            websockets.emplace_back(std::move(client));
+        });
+    }
+
+    // Schreibt alle Metriken im Textformat von Prometheus. Die Kennzahlen der
+    // Shards werden dabei auf deren Threads abgefragt.
+    awaitable<std::string> write_metrics() {
+        std::vector<shard::stats> stats;
+        for (auto& s : shards) {
+            stats.push_back(co_await s->query([](shard& s) { return s.statistics(); }));
+        }
+
+        std::string output;
+        metrics.registry.write(output);
+
+        auto write_shards = [&](std::string_view name, std::string_view help, std::string_view type, auto field) {
+            core::metrics::write_header(output, name, help, type);
+            for (std::size_t i = 0; i < stats.size(); ++i) {
+                core::metrics::write_sample(
+                    output, name, "shard=\"" + std::to_string(i) + '"', static_cast<std::uint64_t>(field(stats[i])));
             }
-            auto id = notification.id;
-            prosumers[notification.id].emplace_back(std::move(notification));
+        };
+        write_shards("hub_prosumers", "Angemeldete Prosumer", "gauge", [](const auto& s) { return s.prosumers; });
+        write_shards("hub_pending_changes", "Änderungen, die auf den nächsten Broadcast warten", "gauge",
+            [](const auto& s) { return s.pending_changes; });
+        write_shards("hub_stale_notifications_total", "Benachrichtigungen, die nicht neuer als der letzte Messwert waren",
+            "counter", [](const auto& s) { return s.stale; });
+        co_return output;
+    }
+
+    // Verschickt die Änderungen an den Prosumern höchstens einmal pro interval an
+    // die WebSockets, und auch nur dann, wenn sich seit dem letzten Mal etwas
+    // geändert hat. So hängen die Kosten des Broadcasts nicht mehr an der
+    // Paketrate. Muss auf broadcast_strand laufen.
+    awaitable<void> run_broadcaster(std::chrono::milliseconds interval) {
+        steady_timer timer { co_await this_coro::executor };
+        for (;;) {
+            timer.expires_after(interval);
+            co_await timer.async_wait(use_awaitable);
 
-            co_await setup_unregister_prosumer_timer(std::move(id));
             co_await broadcast_prosumers();
         }
     }
 
-    void handle_websocket(websocket::stream<tcp::socket> ws) {
-        websockets.emplace_back(std::move(ws));
+private:
+    // Laufende Nummer der Deltas. Ein Snapshot trägt die Nummer des letzten
+    // Deltas, das in ihm bereits enthalten ist.
+    std::uint64_t seq_ { 0 };
+
+    void dispatch(std::size_t local, outbox& out, std::span<core::notification> notifications) {
+        out.hashes.resize(notifications.size());
+
+        std::size_t own = 0;
+        for (auto& notification : notifications) {
+            auto hash = hashed_id { notification.id }.hash;
+            auto index = shard_index(hash);
+            if (index == local) {
+                out.hashes[own] = hash;
+                std::swap(notifications[own++], notification);
+            } else {
+                out.forward[index].notifications.emplace_back(std::move(notification));
+                out.forward[index].hashes.push_back(hash);
+            }
+        }
+        if (own) {
+            shards[local]->update_prosumer(notifications.first(own), std::span { out.hashes }.first(own));
+        }
+
+        for (std::size_t index = 0; index < shards.size(); ++index) {
+            auto& forward = out.forward[index];
+            if (forward.notifications.empty()) {
+                continue;
+            }
+            auto& target = *shards[index];
+            post(target.context(), [this, &target, local, batch = std::move(forward)]() mutable {
+                target.update_prosumer(batch.notifications, batch.hashes);
+                if (local < shards.size()) {
+                    batch.clear();
+                    post(shards[local]->context(), [this, local, batch = std::move(batch)]() mutable {
+                        outboxes[local].spare.emplace_back(std::move(batch));
+                    });
+                }
+            });
+
+            // Der verschickte Stapel wird durch einen zurückgekommenen ersetzt
+            if (out.spare.empty()) {
+                forward = {};
+            } else {
+                forward = std::move(out.spare.back());
+                out.spare.pop_back();
+            }
+        }
     }
 
+    // Ergebnis des Besuchs bei einem Shard
+    struct shard_report {
+        shard::changes changes;
+        std::optional<nlohmann::json> snapshot;
+    };
+
     awaitable<void> broadcast_prosumers() {
-        auto doc = nlohmann::json::object({});
-        for(const auto& [id, notifications] : prosumers) {
-            doc[id] = notifications.back().to_json();
+        auto started = std::chrono::steady_clock::now();
+
+        // Getrennte Verbindungen aufräumen
+        std::erase_if(websockets, [](const auto& client) { return client->closed(); });
+
+        std::size_t queued = 0;
+        for (const auto& client : websockets) {
+            queued += client->queued();
+        }
+        metrics.websocket_clients.set(static_cast<std::int64_t>(websockets.size()));
+        metrics.websocket_queued.set(static_cast<std::int64_t>(queued));
+
+        bool any_delta = false, any_full = false, wants_snapshot = false;
+        for (const auto& client : websockets) {
+            any_delta |= client->delta;
+            any_full |= !client->delta;
+            wants_snapshot |= client->delta && client->needs_snapshot;
         }
-        auto output = doc.dump();
-        co_await broadcast(buffer(output));
-    }
 
-private:
-    template<typename Buffer>
-    awaitable<void> broadcast(Buffer&& buffer) {
-        for (auto& ws : websockets) {
-            ws.async_write(buffer, detached);
+        // Jeder Shard liefert seine Änderungen und bei Bedarf im selben Zug
+        // seinen Snapshot, damit beides zueinander passt.
+        shard::changes changes;
+        std::optional<nlohmann::json> snapshot;
+        if (wants_snapshot) {
+            snapshot = nlohmann::json::object();
+        }
+        for (auto& s : shards) {
+            auto report = co_await s->query([any_delta, wants_snapshot](shard& s) {
+                shard_report report { s.collect_changes(any_delta), std::nullopt };
+                if (wants_snapshot) {
+                    report.snapshot = nlohmann::json::object();
+                    s.snapshot(*report.snapshot);
+                }
+                return report;
+            });
+            merge(changes, std::move(report.changes));
+            if (snapshot) {
+                merge(*snapshot, std::move(*report.snapshot));
+            }
+        }
+
+        if (changes.any) {
+            ++seq_;
+        }
+
+        // Für Clients mit dem alten Protokoll wird der vollständige Stand nur
+        // dann gebraucht, wenn sich etwas geändert hat.
+        if (changes.any && any_full && !snapshot) {
+            snapshot = nlohmann::json::object();
+            for (auto& s : shards) {
+                merge(*snapshot, co_await s->query([](shard& s) {
+                    auto doc = nlohmann::json::object();
+                    s.snapshot(doc);
+                    return doc;
+                }));
+            }
         }
-        co_return;
+
+        // Jede Nachricht wird höchstens einmal pro Takt serialisiert und von allen
+        // Sockets gemeinsam genutzt. Der Puffer lebt, bis der letzte
+        // Schreibvorgang fertig ist.
+        ws_client::message full, delta_snapshot, delta;
+        std::size_t bytes = 0;
+        for (auto& client : websockets) {
+            if (client->delta && client->needs_snapshot) {
+                // Hat sich der Wunsch erst nach dem Einsammeln ergeben, kommt der
+                // Snapshot im nächsten Takt.
+                if (!wants_snapshot) {
+                    continue;
+                }
+                if (!delta_snapshot) {
+                    delta_snapshot = std::make_shared<const std::string>(nlohmann::json {
+                        {"type", "snapshot"},
+                        {"seq", seq_},
+                        {"prosumers", *snapshot},
+                    }.dump());
+                }
+                client->needs_snapshot = false;
+                bytes += delta_snapshot->size();
+                client->send_snapshot(delta_snapshot);
+            } else if (client->delta && changes.any) {
+                if (!delta) {
+                    delta = std::make_shared<const std::string>(nlohmann::json {
+                        {"type", "delta"},
+                        {"seq", seq_},
+                        {"added", std::move(changes.added)},
+                        {"updated", std::move(changes.updated)},
+                        {"removed", std::move(changes.removed)},
+                    }.dump());
+                }
+                bytes += delta->size();
+                client->send_delta(delta);
+            } else if (!client->delta && changes.any) {
+                if (!full) {
+                    full = std::make_shared<const std::string>(snapshot->dump());
+                }
+                bytes += full->size();
+                client->send_snapshot(full);
+            }
+        }
+
+        metrics.broadcasts.add();
+        metrics.broadcast_bytes.add(bytes);
+        metrics.broadcast_duration.observe(std::chrono::steady_clock::now() - started);
     }
 
-    void cancel_timer(std::string id) {
-        auto it = prosumer_timers.find(id);
-        if(it != prosumer_timers.end()) {
-            it->second.cancel();
-            prosumer_timers.erase(it);
+    static void merge(nlohmann::json& into, nlohmann::json&& from) {
+        for (auto& [key, value] : from.items()) {
+            into[key] = std::move(value);
         }
     }
 
-    awaitable<void> setup_unregister_prosumer_timer(std::string id) {
-        cancel_timer(id);
+    static void merge(shard::changes& into, shard::changes&& from) {
+        merge(into.added, std::move(from.added));
+        merge(into.updated, std::move(from.updated));
+        std::move(from.removed.begin(), from.removed.end(), std::back_inserter(into.removed));
+        into.any |= from.any;
+    }
+};
 
-        auto executor = co_await this_coro::executor;
-        co_spawn(executor, [this, id = std::move(id)]() -> awaitable<void> {
-            using namespace std::chrono_literals;
+// Antwortet mit 404 und verwirft dabei bereits gesetzte Felder
+template <typename Res> static awaitable<void> write_not_found(Res& res) {
+    static constexpr std::string_view not_found { "Not Found" };
+    res.fields.clear();
+    res.status_code = core::http::status_code::not_found;
+    res.set_content_type("text/plain; charset=utf-8");
+    res.set_content_length(not_found.size());
+    co_await res.async_write(buffer(not_found));
+}
 
-            auto executor = co_await this_coro::executor;
-            steady_timer timer{executor, 5s};
-            auto [it, _] = prosumer_timers.emplace(id, std::move(timer));
+// Prüft das Frontend in festen Abständen auf Änderungen. Die Dateizugriffe
+// und das Komprimieren passieren nur hier, nie beim Beantworten einer Request.
+// Läuft auf einem eigenen Thread, damit ein geändertes großes Asset die
+// HTTP- und WebSocket-Verbindungen nicht für die Dauer von gzip und Brotli
+// auf höchster Stufe anhält. Den Requests wird nur die fertige Tabelle
+// atomar untergeschoben.
+static awaitable<void> refresh_assets(asset_cache& assets, std::chrono::milliseconds interval) {
+    steady_timer timer { co_await this_coro::executor };
+    for (;;) {
+        timer.expires_after(interval);
+        co_await timer.async_wait(use_awaitable);
+        if (assets.refresh()) {
+            core::log::info("Frontend wurde neu geladen");
+        }
+    }
+}
 
-            co_await it->second.async_wait(use_awaitable);
-            co_await unregister_prosumer(std::move(id));
-        }, detached);
+int main(int argc, char** argv) {
+    static cxxopts::Options options { "hub", "Zentrale für Producer und Consumer" };
+    // clang-format off
+    options.add_options()
+        ("t,threads", "Anzahl der Threads für den Prosumer-Zustand und den UDP-Empfang (0 = Anzahl der Kerne)",
+            cxxopts::value<unsigned int>()->default_value("0"))
+        ("http-threads", "Anzahl der Threads für HTTP und WebSockets",
+            cxxopts::value<unsigned int>()->default_value("1"))
+        ("prosumer-timeout", "Schonfrist in ms, nach der ein Prosumer ohne Benachrichtigung abgemeldet wird",
+            cxxopts::value<unsigned int>()->default_value("5000"))
+        ("timeout-granularity", "Genauigkeit der Abmeldung in ms, um so viel kann sie sich verspäten",
+            cxxopts::value<unsigned int>()->default_value("250"))
+        ("keep-alive-timeout", "Zeit in Millisekunden, die eine HTTP-Verbindung ohne Request offen bleibt",
+            cxxopts::value<unsigned int>()->default_value("5000"))
+        ("keep-alive-requests", "Maximale Anzahl an Requests pro HTTP-Verbindung",
+            cxxopts::value<unsigned int>()->default_value("100"))
+        ("b,broadcast-interval", "Minimaler Abstand zwischen zwei WebSocket-Broadcasts in ms",
+            cxxopts::value<unsigned int>()->default_value("100"))
+        ("ws-queue", "Maximale Anzahl wartender Nachrichten pro WebSocket",
+            cxxopts::value<std::size_t>()->default_value("16"))
+        ("ws-max-lag", "Zeit in ms, nach der ein hinterherhängender WebSocket getrennt wird",
+            cxxopts::value<unsigned int>()->default_value("5000"))
+        ("frontend", "Verzeichnis mit den Dateien des Frontends",
+            cxxopts::value<std::string>()->default_value("../frontend"))
+        ("asset-refresh", "Abstand in ms, in dem das Frontend auf Änderungen geprüft wird (0 = nie)",
+            cxxopts::value<unsigned int>()->default_value("1000"))
+        ("asset-max-size", "Dateien des Frontends bis zu dieser Größe in Bytes liegen im Speicher, größere "
+                           "werden direkt von der Platte geschickt",
+            cxxopts::value<std::size_t>()->default_value("65536"))
+        ("docs", "Verzeichnis, das unter /docs/ ausgeliefert wird",
+            cxxopts::value<std::string>()->default_value("../docs"))
+        ("log-level", "Minimales Log-Level (debug, info, warning, error)",
+            cxxopts::value<std::string>()->default_value("info"))
+        ("log-sample", "Nur jede n-te erfolgreiche Request ins Access-Log schreiben (0 = keine)",
+            cxxopts::value<unsigned int>()->default_value("1"))
+        ("h,help", "Hilfe-Seite anzeigen");
+    // clang-format on
+    auto result = options.parse(argc, argv);
+
+    if (result.count("help")) {
+        std::cout << options.help() << std::endl;
+        exit(0);
     }
 
-    awaitable<void> unregister_prosumer(std::string id) {
-        std::cout << "Prosumer mit der ID " << id << " wird abgemeldet" << std::endl;
-        cancel_timer(id);
-        prosumers.erase(id);
-        co_await broadcast_prosumers();
+    if (auto level = core::log::parse_level(result["log-level"].as<std::string>())) {
+        core::log::set_level(*level);
+    } else {
+        std::cerr << "Unbekanntes Log-Level: " << result["log-level"].as<std::string>() << std::endl;
+        exit(1);
     }
-};
+    core::log::set_sample_rate(result["log-sample"].as<unsigned int>());
 
+    // Mit 0 würde der Broadcaster ohne Pause laufen und einen Thread auslasten
+    std::chrono::milliseconds broadcast_interval { std::max(result["broadcast-interval"].as<unsigned int>(), 1u) };
+
+    std::size_t num_shards = result["threads"].as<unsigned int>();
+    if (num_shards == 0) {
+        num_shards = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    std::size_t num_http_threads = std::max(result["http-threads"].as<unsigned int>(), 1u);
 
-int main() {
     using router = core::router<tcp::socket>;
 
-    state state;
+    // HTTP und WebSockets laufen in einem eigenen Thread-Pool, getrennt von
+    // den Shards, die UDP empfangen und den Zustand der Prosumer halten.
+    io_context web_ctx { static_cast<int>(num_http_threads) };
 
-    io_context ctx { 1 };
+    shard::liveness liveness {
+        std::chrono::milliseconds { result["prosumer-timeout"].as<unsigned int>() },
+        std::chrono::milliseconds { std::max(result["timeout-granularity"].as<unsigned int>(), 1u) },
+    };
 
-    router r;
+    state state { web_ctx, num_shards, liveness };
+    state.ws_limits = {
+        .max_queue = std::max<std::size_t>(result["ws-queue"].as<std::size_t>(), 1),
+        .max_lag = std::chrono::milliseconds { result["ws-max-lag"].as<unsigned int>() },
+    };
+
+    asset_cache assets { result["frontend"].as<std::string>(), result["asset-max-size"].as<std::size_t>() };
+    ghc::filesystem::path docs_root { result["docs"].as<std::string>() };
 
-    // Requests und Respones loggen
-    r.use(logging_middleware);
+    router r;
+    // Metriken und Access-Log laufen erst, wenn die Session die Response
+    // vollständig geschrieben hat. Nur so stimmen Status und Bytes auch bei
+    // Fehlern, die die Session selbst beantwortet (400, 413, 431).
+    http_metrics http_stats { state.metrics.registry };
+    r.set_session_options({
+        .idle_timeout = std::chrono::milliseconds { result["keep-alive-timeout"].as<unsigned int>() },
+        .max_requests = std::max(result["keep-alive-requests"].as<unsigned int>(), 1u),
+        .on_complete = [&http_stats](const auto& res, const auto& req) {
+            http_stats.observe(res, req);
+            log_access(res, req);
+        },
+    });
 
     // URL normalisieren
-    r.use([](auto& res, auto& req, auto next) -> awaitable<void> {
+    r.use([](auto& res, auto& req) {
         ghc::filesystem::path parsed { "/" };
         parsed /= req.url;
         parsed = ghc::filesystem::weakly_canonical(parsed);
         req.url = parsed.c_str();
-        co_await next();
     });
 
-    r.use("/api/v1/prosumers/", router::exact_match, [&state](auto& res, auto& req, auto next) -> awaitable<void> {
-        auto doc = nlohmann::json::array({});
-        for(const auto& [_, notifications] : state.prosumers) {
-            doc.emplace_back(notifications.back().to_json());
+    // Nimmt Benachrichtigungen stapelweise per POST entgegen, eine JSON-Nachricht
+    // pro Zeile (NDJSON). Der Body wird stückweise gelesen, im Speicher liegt
+    // also nie mehr als ein Stapel.
+    r.post("/api/v1/prosumers", [&state](auto& res, auto& req, auto next) -> awaitable<void> {
+        std::vector<core::notification> batch;
+        batch.reserve(bulk_batch_size);
+        std::string partial;
+        std::size_t accepted = 0, rejected = 0;
+
+        auto handle_line = [&](std::string_view line) {
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (line.empty()) {
+                return;
+            }
+            try {
+                batch.emplace_back().decode(line);
+                ++accepted;
+            } catch (std::exception&) {
+                batch.pop_back();
+                ++rejected;
+            }
+            if (batch.size() == bulk_batch_size) {
+                state.ingest(batch);
+                batch.clear();
+            }
+        };
+
+        for (;;) {
+            auto piece = co_await req.async_read_some_body();
+            if (piece.empty()) {
+                break;
+            }
+
+            // Vollständige Zeilen werden direkt im Empfangspuffer verarbeitet,
+            // nur eine angebrochene Zeile wird kopiert.
+            while (!piece.empty()) {
+                auto eol = piece.find('\n');
+                if (eol == piece.npos) {
+                    partial.append(piece);
+                    break;
+                }
+                if (partial.empty()) {
+                    handle_line(piece.substr(0, eol));
+                } else {
+                    partial.append(piece.substr(0, eol));
+                    handle_line(partial);
+                    partial.clear();
+                }
+                piece.remove_prefix(eol + 1);
+            }
+
+            if (partial.size() > bulk_max_line) {
+                std::string_view output { "Zeile zu lang" };
+                res.status_code = core::http::status_code::bad_request;
+                res.set_content_length(output.size());
+                co_await res.async_write(buffer(output));
+                co_return;
+            }
+        }
+        handle_line(partial);
+        if (!batch.empty()) {
+            state.ingest(batch);
         }
-        auto output = doc.dump(4);
+
+        auto output = nlohmann::json {
+            {"accepted", accepted},
+            {"rejected", rejected},
+        }.dump();
         res.set_content_length(output.size());
         res.set_content_type("application/json");
         co_await res.async_write(buffer(output));
     });
 
-    r.use("/api/v1/prosumers/", [&state](auto& res, auto& req, auto next) -> awaitable<void> {
-        auto prosumer_id = req.url.substr(18);
-        if(!prosumer_id.empty() && prosumer_id[prosumer_id.size() - 1] == '/') {
-            prosumer_id = prosumer_id.substr(0, prosumer_id.size() - 1);
+    // Die Antworten der REST-Schnittstelle werden gestreamt: Jeder Shard bzw.
+    // jeder Messwert wird geschrieben, sobald er vorliegt, statt zuerst das
+    // ganze Dokument aufzubauen.
+    r.get("/api/v1/prosumers", [&state](auto& res, auto& req, auto next) -> awaitable<void> {
+        res.set_content_type("application/json");
+        auto writer = res.chunked();
+
+        co_await writer.async_write("[");
+        bool first = true;
+        for (auto& s : state.shards) {
+            auto part = co_await s->query([](shard& s) {
+                auto doc = nlohmann::json::array({});
+                s.latest(doc);
+                return doc;
+            });
+            for (const auto& prosumer : part) {
+                writer.buffer() += first ? "\n" : ",\n";
+                first = false;
+                co_await writer.async_write(prosumer.dump());
+            }
         }
+        co_await writer.async_write("\n]\n");
+        co_await writer.async_finish();
+    });
 
-        if(!state.prosumers.contains(prosumer_id)) {
+    r.get("/api/v1/prosumers/:id", [&state](auto& res, auto& req, auto next) -> awaitable<void> {
+        std::string prosumer_id { *req.param("id") };
+
+        auto samples = co_await state.owner(prosumer_id).query(
+            [&prosumer_id](shard& s) { return s.history_of(prosumer_id); });
+        if(!samples) {
             std::string output{"Der Prosumer mit ID " + prosumer_id + " existiert nicht."};
             res.status_code = core::http::status_code::not_found;
             res.set_content_length(output.size());
@@ -171,70 +734,136 @@ int main() {
             co_return;
         }
 
-        auto doc = nlohmann::json::array({});
-        for(auto& notification : state.prosumers[prosumer_id]) {
-            doc.emplace_back(notification.to_json());
+        // Mit ?format=csv kommt der Verlauf als CSV statt als JSON
+        if (req.query() == "format=csv") {
+            res.set_content_type("text/csv; charset=utf-8");
+            auto writer = res.chunked();
+            co_await writer.async_write("id,timestamp,power,pos_x,pos_y,type,subtype\n");
+
+            auto id = csv_field(prosumer_id);
+            const auto& type = samples->type();
+            auto subtype = std::visit([](auto subtype) { return static_cast<unsigned int>(subtype); }, type);
+
+            // Der Verlauf ist auf history_size Messwerte beschränkt und landet
+            // deshalb in einem Chunk
+            samples->for_each([&](const auto& sample) {
+                char line[128];
+                auto length = std::snprintf(line, sizeof(line), ",%lld,%llu,", static_cast<long long>(sample.timestamp),
+                    static_cast<unsigned long long>(sample.power));
+                writer.buffer() += id;
+                writer.buffer().append(line, static_cast<std::size_t>(length));
+                append_csv_number(writer.buffer(), sample.pos_x);
+                writer.buffer() += ',';
+                append_csv_number(writer.buffer(), sample.pos_y);
+                length = std::snprintf(line, sizeof(line), ",%zu,%u\n", type.index(), subtype);
+                writer.buffer().append(line, static_cast<std::size_t>(length));
+            });
+            co_await writer.async_finish();
+            co_return;
         }
-        auto output = doc.dump(4);
-        res.set_content_length(output.size());
+
         res.set_content_type("application/json");
-        co_await res.async_write(buffer(output));
+        auto writer = res.chunked();
+        writer.buffer() += '[';
+        bool first = true;
+        samples->for_each([&](const auto& sample) {
+            writer.buffer() += first ? "\n" : ",\n";
+            first = false;
+            auto doc = core::notification::to_json(
+                prosumer_id, sample.power, sample.pos_x, sample.pos_y, samples->type(), sample.timestamp);
+            writer.buffer() += doc.dump();
+        });
+        co_await writer.async_write("\n]\n");
+        co_await writer.async_finish();
     });
 
-    r.use("/ws", [&state](auto& res, auto& req, auto next) -> awaitable<void> {
+    r.get("/ws", [&state](auto& res, auto& req, auto next) -> awaitable<void> {
         http::request<http::string_body> beast_req;
         beast_req.method_string("GET");
-        for (const auto& [field, value] : req.fields) {
-            beast_req.set(field, value);
+        for (auto [field, value] : req.fields) {
+            beast_req.set(boost::beast::string_view { field.data(), field.size() },
+                boost::beast::string_view { value.data(), value.size() });
         }
 
+        // Mit /ws?protocol=delta wählt der Client das Delta-Protokoll
+        bool delta = req.query() == "protocol=delta";
+
         websocket::stream<tcp::socket> ws { std::move(req).get_socket() };
         co_await ws.async_accept(beast_req, use_awaitable);
-        state.handle_websocket(std::move(ws));
+        state.handle_websocket(std::move(ws), delta);
     });
 
-    r.use("/", router::exact_match, [](auto& res, auto& req, auto next) -> awaitable<void> {
-        req.url = "/index.html";
-        co_await next();
+    r.get("/metrics", [&state](auto& res, auto& req, auto next) -> awaitable<void> {
+        auto output = co_await state.write_metrics();
+        res.set_content_type("text/plain; version=0.0.4; charset=utf-8");
+        res.set_content_length(output.size());
+        co_await res.async_write(buffer(output));
     });
 
-    r.use([](auto& res, auto& req, auto next) -> awaitable<void> {
-        ghc::filesystem::path target_file{"../frontend"};
-        target_file /= req.url.substr(1);
-        if(!ghc::filesystem::exists(target_file)) {
-            res.status_code = core::http::status_code::not_found;
-            co_await res.async_write(buffer(std::string_view{"Not Found"}));
+    r.get("/", [](auto& res, auto& req) { req.url = "/index.html"; });
+
+    // Dokumentation, direkt von der Platte. Der Pfad ist bereits normalisiert
+    // und kann deshalb nicht aus dem Verzeichnis herausführen.
+    r.use("/docs/", [&docs_root](auto& res, auto& req, auto next) -> awaitable<void> {
+        auto file = docs_root / std::string { req.path().substr(6) };
+        res.set_content_type(asset_cache::content_type_of(file));
+        if (!co_await res.async_send_file(req, file.string())) {
+            co_await write_not_found(res);
+        }
+    });
+
+    // Statische Dateien des Frontends. Kleine Dateien kommen aus dem Speicher,
+    // große per sendfile von der Platte.
+    r.use([&assets](auto& res, auto& req, auto next) -> awaitable<void> {
+        auto asset = assets.find(req.path());
+        if (!asset) {
+            co_await write_not_found(res);
             co_return;
         }
 
-        static std::unordered_map<std::string_view, std::string_view> mime_types{
-            {".html", "text/html; charset=utf-8"},
-            {".css", "text/css; charset=utf-8"},
-            {".js", "application/javascript; charset=utf-8"},
-            {".svg", "image/svg+xml; charset=utf-8"}
-        };
-        auto extension = target_file.extension();
-        if(mime_types.contains(extension.c_str())) {
-            res.set_content_type(mime_types[extension.c_str()]);
-        } else {
-            res.set_content_type("text/plain; charset=utf-8");
+        const auto& variant = asset->select(req.field("Accept-Encoding"));
+        res.fields["ETag"] = variant.etag;
+        res.fields["Cache-Control"] = asset->cache_control;
+        res.fields["Vary"] = "Accept-Encoding";
+
+        if (auto if_none_match = req.field("If-None-Match");
+            if_none_match && asset_cache::matches(*if_none_match, variant.etag)) {
+            res.status_code = core::http::status_code::not_modified;
+            co_return;
         }
 
-        std::ifstream input{target_file, std::ios::binary};
-        std::string body{std::istreambuf_iterator<char>(input), {}};
-        res.set_content_length(body.size());
-        co_await res.async_write(buffer(body));
+        res.set_content_type(asset->content_type);
+        if (!asset->file.empty()) {
+            if (!co_await res.async_send_file(req, asset->file)) {
+                co_await write_not_found(res);
+            }
+            co_return;
+        }
+        if (!variant.encoding.empty()) {
+            res.fields["Content-Encoding"] = variant.encoding;
+        }
+        res.set_content_length(variant.body.size());
+        co_await res.async_write(buffer(variant.body));
     });
 
-    // HTTP-Server
+    http_stats.add_routes(r.routes());
+
+    // Lädt geänderte Dateien des Frontends im Hintergrund neu
+    thread_pool asset_refresher { 1 };
+    if (auto interval = result["asset-refresh"].as<unsigned int>(); interval > 0) {
+        co_spawn(asset_refresher, refresh_assets(assets, std::chrono::milliseconds { interval }), detached);
+    }
+
+    // HTTP-Server. Jede Verbindung bekommt einen eigenen Strand, damit ihre
+    // Handler auch mit mehreren HTTP-Threads nie gleichzeitig laufen.
     co_spawn(
-        ctx,
-        [&ctx, &r]() mutable -> awaitable<void> {
+        web_ctx,
+        [&web_ctx, &r]() mutable -> awaitable<void> {
             tcp::endpoint endpoint { tcp::v4(), 3000 };
-            tcp::acceptor acceptor { ctx, endpoint };
+            tcp::acceptor acceptor { web_ctx, endpoint };
 
             for (;;) {
-                tcp::socket socket { ctx };
+                tcp::socket socket { make_strand(web_ctx) };
                 co_await acceptor.async_accept(socket, use_awaitable);
                 r.handle_connection(std::move(socket), log_exception);
             }
@@ -243,26 +872,75 @@ int main() {
         },
         throw_exception);
 
-    // UDP-Server
-    co_spawn(
-        ctx,
-        [&ctx, &state]() mutable -> awaitable<void> {
-            udp::endpoint endpoint { udp::v4(), 3000 };
-            auto socket = use_awaitable.as_default_on(udp::socket { ctx, endpoint });
-
-            std::string str;
-            for (;;) {
-                str.resize(1024);
+    // UDP-Server. Mit SO_REUSEPORT hat jeder Shard einen eigenen Socket auf
+    // demselben Port, und der Kernel verteilt die Datagramme auf die Shards.
+    // Ohne SO_REUSEPORT empfängt nur der erste Shard.
+#ifdef SO_REUSEPORT
+    const std::size_t num_receivers = num_shards;
+#else
+    const std::size_t num_receivers = 1;
+#endif
+    for (std::size_t index = 0; index < num_receivers; ++index) {
+        auto& ctx = state.shards[index]->context();
+        co_spawn(
+            ctx,
+            [&ctx, &state, index]() mutable -> awaitable<void> {
+                udp::endpoint endpoint { udp::v4(), 3000 };
+                udp::socket socket { ctx, endpoint.protocol() };
+                socket.set_option(udp::socket::reuse_address(true));
+#ifdef SO_REUSEPORT
+                socket.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+                socket.bind(endpoint);
+
+                // Die Datagramme werden stapelweise in vorab allokierte Slots gelesen
+                // und anschließend gemeinsam verarbeitet.
+                auto receiver = std::make_unique<core::udp::batch_receiver<udp_batch_size, udp_slot_size>>();
+                std::vector<core::notification> batch(udp_batch_size);
+
+                for (;;) {
+                    auto count = co_await receiver->async_receive(socket);
+                    auto started = std::chrono::steady_clock::now();
+
+                    // Ein Datagramm kann einen ganzen Stapel enthalten, alle werden in
+                    // einem Durchgang hintereinander in batch entpackt. Ein ungültiger
+                    // Stapel wird komplett verworfen.
+                    std::size_t decoded = 0;
+                    std::size_t valid = 0;
+                    for (std::size_t i = 0; i < count; ++i) {
+                        try {
+                            decoded = core::decode_datagram((*receiver)[i], batch, decoded);
+                            ++valid;
+                        } catch (std::exception& err) {
+                            core::log::warning("Ungültiges Datagramm verworfen").field("error", err.what());
+                        }
+                    }
+                    state.dispatch(index, std::span { batch.data(), decoded });
+
+                    state.metrics.udp_received.add(count);
+                    state.metrics.udp_decoded.add(valid);
+                    state.metrics.udp_rejected.add(count - valid);
+                    state.metrics.udp_notifications.add(decoded);
+                    state.metrics.ingest_duration.observe(std::chrono::steady_clock::now() - started);
+                }
+            },
+            throw_exception);
+    }
 
-                auto length = co_await socket.async_receive(buffer(str));
-                str.resize(length);
+    // WebSocket-Broadcasts im festen Takt
+    co_spawn(state.broadcast_strand, state.run_broadcaster(broadcast_interval), throw_exception);
 
-                core::notification notification;
-                notification.decode(str);
-                co_await state.update_prosumer(std::move(notification));
-            }
-        },
-        throw_exception);
+    // Ein Thread pro Shard
+    std::vector<std::thread> threads;
+    for (auto& s : state.shards) {
+        threads.emplace_back([&ctx = s->context()] { ctx.run(); });
+    }
+    for (std::size_t i = 1; i < num_http_threads; ++i) {
+        threads.emplace_back([&web_ctx] { web_ctx.run(); });
+    }
+    web_ctx.run();
 
-    ctx.run();
+    for (auto& thread : threads) {
+        thread.join();
+    }
 }
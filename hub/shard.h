@@ -0,0 +1,284 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <nlohmann/json.hpp>
+
+#include "history.h"
+#include "log.h"
+#include "models.h"
+#include "slot_table.h"
+#include "timer_wheel.h"
+
+// shard hält einen Teil der Prosumer. Welcher Shard für einen Prosumer
+// zuständig ist, ergibt sich aus dem Hash seiner ID. Jeder Shard besitzt einen
+// eigenen io_context, der von genau einem Thread ausgeführt wird. Alle Daten
+// des Shards werden nur von diesem Thread angefasst, deshalb braucht es auf dem
+// heißen Pfad keine Locks. Andere Threads greifen über query() zu, das die
+// Arbeit auf den Thread des Shards verlagert.
+class shard {
+public:
+    // Wir speichern die letzten 120 Einträge
+    static constexpr std::size_t history_size = 120;
+
+    // Was sich an einem Prosumer seit dem letzten Broadcast geändert hat
+    enum change : std::uint8_t {
+        change_added = 1 << 0,
+        change_power = 1 << 1,
+        change_position = 1 << 2,
+        change_type = 1 << 3,
+        change_timestamp = 1 << 4,
+    };
+
+    // Alles, was der Hub pro Prosumer speichert. Der Verlauf liegt in einem
+    // eigenen Block, damit das Slot-Array kompakt bleibt.
+    struct prosumer {
+        std::unique_ptr<history<history_size>> samples {};
+        std::uint8_t changes { 0 };
+    };
+
+    // Ein Prosumer wird abgemeldet, wenn er sich timeout lang nicht gemeldet
+    // hat. timeout ist damit die Schonfrist, die ein Prosumer zwischen zwei
+    // Benachrichtigungen hat, und sollte ein Vielfaches seines Sendeabstands
+    // sein, damit einzelne verlorene Datagramme nicht zur Abmeldung führen.
+    // Geprüft wird im Abstand von granularity, abgemeldet wird also nach
+    // mindestens timeout und weniger als timeout + granularity.
+    struct liveness {
+        std::chrono::steady_clock::duration timeout;
+        std::chrono::steady_clock::duration granularity;
+    };
+
+    using handle = slot_table<prosumer>::handle;
+
+    // Ein Stapel Benachrichtigungen für einen Shard, zu jeder der Hash ihrer ID
+    // (siehe hashed_id). Wird nach dem Abarbeiten geleert und wiederverwendet.
+    struct batch {
+        std::vector<core::notification> notifications {};
+        std::vector<std::size_t> hashes {};
+
+        void clear() noexcept {
+            notifications.clear();
+            hashes.clear();
+        }
+    };
+
+    // Änderungen seit dem letzten Broadcast, bereits als JSON aufbereitet
+    struct changes {
+        nlohmann::json added = nlohmann::json::object();
+        nlohmann::json updated = nlohmann::json::object();
+        std::vector<std::string> removed {};
+        bool any { false };
+    };
+
+    // Kennzahlen für die Metriken des Hubs
+    struct stats {
+        std::size_t prosumers;
+        std::size_t pending_changes;
+        std::uint64_t stale;
+    };
+
+private:
+    boost::asio::io_context ctx_ { 1 };
+
+    slot_table<prosumer> prosumers_ {};
+
+    // Überwacht die Lebenszeichen der Prosumer. Die Handles sind die der slot_table.
+    timer_wheel liveness_;
+
+    // Prosumer, deren changes seit dem letzten Broadcast gesetzt wurden. Ein
+    // Handle kann mehrfach enthalten sein, falls sein Slot zwischendurch
+    // freigegeben und wiederverwendet wurde.
+    std::vector<handle> dirty_ {};
+
+    // IDs der Prosumer, die sich seit dem letzten Broadcast abgemeldet haben
+    std::vector<std::string> removed_ {};
+
+    // Benachrichtigungen, die nicht neuer als der letzte Messwert waren
+    std::uint64_t stale_ { 0 };
+
+public:
+    explicit shard(liveness liveness)
+        : liveness_(liveness.timeout, liveness.granularity) {
+        boost::asio::co_spawn(ctx_, run_liveness(this), boost::asio::detached);
+    }
+
+    boost::asio::io_context& context() noexcept {
+        return ctx_;
+    }
+
+    // Übernimmt einen Stapel von Benachrichtigungen, die alle zu diesem Shard
+    // gehören, mit den bereits berechneten Hashes ihrer IDs. Darf nur auf dem
+    // Thread des Shards aufgerufen werden.
+    void update_prosumer(std::span<core::notification> notifications, std::span<const std::size_t> hashes) {
+        auto now = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < notifications.size(); ++i) {
+            auto& notification = notifications[i];
+
+            // Die ID wurde genau einmal gehasht, danach wird nur noch mit dem Handle gearbeitet
+            auto [h, not_exist] = prosumers_.intern(hashed_id { notification.id, hashes[i] });
+            auto& p = prosumers_[h];
+            if (not_exist) {
+                p.samples = std::make_unique<history<history_size>>();
+                p.samples->push(notification);
+                mark_changed(h, change_added);
+            } else if (auto last = p.samples->back(); last.timestamp < notification.timestamp) {
+                // Zeitstempel haben Millisekunden, mehrere Werte pro Sekunde kommen also
+                // durch. Verworfen wird nur, was nicht neuer als der letzte Wert ist.
+                std::uint8_t changes = change_timestamp;
+                if (last.power != notification.power) {
+                    changes |= change_power;
+                }
+                if (last.pos_x != notification.pos_x || last.pos_y != notification.pos_y) {
+                    changes |= change_position;
+                }
+                if (p.samples->type() != notification.type) {
+                    changes |= change_type;
+                }
+                p.samples->push(notification);
+                mark_changed(h, changes);
+            } else {
+                ++stale_;
+                continue;
+            }
+
+            liveness_.touch(h, now);
+        }
+    }
+
+    // Führt f(shard&) auf dem Thread des Shards aus und liefert das Ergebnis zurück
+    template <typename F> auto query(F f) {
+        return boost::asio::co_spawn(ctx_, run_query(this, std::move(f)), boost::asio::use_awaitable);
+    }
+
+    std::size_t size() const noexcept {
+        return prosumers_.size();
+    }
+
+    stats statistics() const noexcept {
+        return { prosumers_.size(), dirty_.size() + removed_.size(), stale_ };
+    }
+
+    static nlohmann::json latest_to_json(const std::string& id, const prosumer& p) {
+        auto sample = p.samples->back();
+        return core::notification::to_json(
+            id, sample.power, sample.pos_x, sample.pos_y, p.samples->type(), sample.timestamp);
+    }
+
+    // Fügt den aktuellen Stand aller Prosumer dieses Shards in das Objekt doc ein
+    void snapshot(nlohmann::json& doc) const {
+        prosumers_.for_each([&](handle, const std::string& id, const prosumer& p) {
+            doc[id] = latest_to_json(id, p);
+        });
+    }
+
+    // Hängt den aktuellen Stand aller Prosumer dieses Shards an das Array doc an
+    void latest(nlohmann::json& doc) const {
+        prosumers_.for_each([&](handle, const std::string& id, const prosumer& p) {
+            doc.emplace_back(latest_to_json(id, p));
+        });
+    }
+
+    // Kopie des Verlaufs eines Prosumers, falls er bekannt ist. Der Verlauf
+    // hat eine feste Größe, die Kopie ist deshalb billig und kann außerhalb des
+    // Shards in Ruhe serialisiert werden.
+    std::optional<history<history_size>> history_of(const std::string& id) const {
+        auto h = prosumers_.find(id);
+        if (!h) {
+            return std::nullopt;
+        }
+        return *prosumers_[*h].samples;
+    }
+
+    // Entnimmt die Änderungen seit dem letzten Aufruf. Ist build false, werden
+    // sie nur verworfen, ohne dafür JSON zu erzeugen. Für geänderte Prosumer
+    // werden nur die geänderten Felder übertragen.
+    changes collect_changes(bool build) {
+        changes result;
+        result.any = !dirty_.empty() || !removed_.empty();
+
+        for (auto h : dirty_) {
+            if (!prosumers_.contains(h) || !prosumers_[h].changes) {
+                continue;
+            }
+            auto& p = prosumers_[h];
+            if (build) {
+                append_change(result, prosumers_.id(h), p);
+            }
+            p.changes = 0;
+        }
+        dirty_.clear();
+
+        result.removed = std::move(removed_);
+        removed_.clear();
+        return result;
+    }
+
+private:
+    template <typename F> static boost::asio::awaitable<std::invoke_result_t<F, shard&>> run_query(shard* self, F f) {
+        co_return f(*self);
+    }
+
+    void mark_changed(handle h, std::uint8_t changes) {
+        auto& p = prosumers_[h];
+        if (!p.changes) {
+            dirty_.push_back(h);
+        }
+        p.changes |= changes;
+    }
+
+    static void append_change(changes& result, const std::string& id, const prosumer& p) {
+        if (p.changes & change_added) {
+            result.added[id] = latest_to_json(id, p);
+            return;
+        }
+
+        auto sample = p.samples->back();
+        auto fields = nlohmann::json::object();
+        if (p.changes & change_power) {
+            fields["power"] = sample.power;
+        }
+        if (p.changes & change_position) {
+            fields["pos_x"] = sample.pos_x;
+            fields["pos_y"] = sample.pos_y;
+        }
+        if (p.changes & change_type) {
+            const auto& type = p.samples->type();
+            fields["type"] = type.index();
+            fields["subtype"] = std::visit([](auto subtype) { return static_cast<std::uint8_t>(subtype); }, type);
+        }
+        if (p.changes & change_timestamp) {
+            fields["timestamp"] = sample.timestamp;
+        }
+        result.updated[id] = std::move(fields);
+    }
+
+    // Ein einziger Timer pro Shard räumt in festem Takt alle Prosumer ab, die
+    // sich zu lange nicht gemeldet haben.
+    static boost::asio::awaitable<void> run_liveness(shard* self) {
+        boost::asio::steady_timer timer { self->ctx_ };
+        for (;;) {
+            timer.expires_after(self->liveness_.granularity());
+            co_await timer.async_wait(boost::asio::use_awaitable);
+
+            self->liveness_.advance(
+                std::chrono::steady_clock::now(), [self](handle h) { self->unregister_prosumer(h); });
+        }
+    }
+
+    void unregister_prosumer(handle h) {
+        core::log::info("Prosumer wird abgemeldet").field("id", prosumers_.id(h));
+        removed_.push_back(prosumers_.id(h));
+        prosumers_.erase(h);
+    }
+};
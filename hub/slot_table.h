@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// slot_table verwaltet Einträge, die über eine String-ID angesprochen werden,
+// in einem dichten Array. Beim ersten Auftreten wird die ID einmalig auf ein
+// kompaktes Handle (den Index im Array) abgebildet ("Interning"). Alle weiteren
+// Zugriffe laufen über das Handle und kommen ohne Hashing aus.
+//
+// Freigegebene Slots landen in einer Freiliste und werden beim nächsten
+// Einfügen wiederverwendet, sodass das Array nicht mit der Zahl der jemals
+// gesehenen IDs wächst, sondern mit der Zahl der gleichzeitig aktiven.
+//
+// Wer den Hash einer ID ohnehin schon braucht (z.B. um den zuständigen Shard
+// zu bestimmen), übergibt sie als hashed_id. Die Tabelle rechnet ihn dann
+// nicht noch einmal aus.
+struct hashed_id {
+    std::string_view id;
+    std::size_t hash;
+
+    explicit hashed_id(std::string_view id) noexcept
+        : id(id)
+        , hash(std::hash<std::string_view> {}(id)) { }
+
+    // Für einen Hash, der bereits vorher aus id berechnet wurde
+    hashed_id(std::string_view id, std::size_t hash) noexcept
+        : id(id)
+        , hash(hash) { }
+};
+
+template <typename T> class slot_table {
+public:
+    using handle = std::uint32_t;
+
+    static constexpr handle invalid_handle = std::numeric_limits<handle>::max();
+
+private:
+    struct slot {
+        // Zeigt auf den Schlüssel in index_. Knoten einer std::unordered_map
+        // verschieben sich nicht, die ID wird dadurch nur einmal gespeichert.
+        const std::string* id { nullptr };
+        T value {};
+    };
+
+    // Hasht Strings wie std::hash<std::string> und übernimmt bei einer
+    // hashed_id den fertigen Hash
+    struct id_hash {
+        using is_transparent = void;
+
+        std::size_t operator()(std::string_view id) const noexcept {
+            return std::hash<std::string_view> {}(id);
+        }
+
+        std::size_t operator()(const hashed_id& id) const noexcept {
+            return id.hash;
+        }
+    };
+
+    struct id_equal {
+        using is_transparent = void;
+
+        bool operator()(std::string_view a, std::string_view b) const noexcept {
+            return a == b;
+        }
+
+        bool operator()(const hashed_id& a, std::string_view b) const noexcept {
+            return a.id == b;
+        }
+
+        bool operator()(std::string_view a, const hashed_id& b) const noexcept {
+            return a == b.id;
+        }
+    };
+
+    std::unordered_map<std::string, handle, id_hash, id_equal> index_ {};
+    std::vector<slot> slots_ {};
+    std::vector<handle> free_ {};
+
+public:
+    // Liefert das Handle zur ID und legt bei Bedarf einen neuen Slot an. Das
+    // zweite Element ist true, falls der Slot neu angelegt wurde. Kostet für
+    // eine bekannte ID genau eine Hash-Suche mit dem Hash aus id, nur eine
+    // neue ID wird beim Einfügen noch einmal gehasht.
+    std::pair<handle, bool> intern(const hashed_id& id) {
+        if (auto it = index_.find(id); it != index_.end()) {
+            return { it->second, false };
+        }
+
+        auto next = free_.empty() ? static_cast<handle>(slots_.size()) : free_.back();
+        auto it = index_.try_emplace(std::string { id.id }, next).first;
+
+        if (free_.empty()) {
+            slots_.emplace_back();
+        } else {
+            free_.pop_back();
+        }
+        slots_[next].id = &it->first;
+        return { next, true };
+    }
+
+    std::optional<handle> find(std::string_view id) const {
+        auto it = index_.find(id);
+        if (it == index_.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    // Gibt den Slot frei. Der Wert wird auf seinen Standardwert zurückgesetzt.
+    void erase(handle h) {
+        auto& s = slots_[h];
+        index_.erase(*s.id);
+        s.id = nullptr;
+        s.value = T {};
+        free_.push_back(h);
+    }
+
+    bool contains(handle h) const noexcept {
+        return h < slots_.size() && slots_[h].id != nullptr;
+    }
+
+    const std::string& id(handle h) const noexcept {
+        return *slots_[h].id;
+    }
+
+    T& operator[](handle h) noexcept {
+        return slots_[h].value;
+    }
+
+    const T& operator[](handle h) const noexcept {
+        return slots_[h].value;
+    }
+
+    std::size_t size() const noexcept {
+        return index_.size();
+    }
+
+    bool empty() const noexcept {
+        return index_.empty();
+    }
+
+    // Ruft f(handle, id, value) für alle belegten Slots auf
+    template <typename F> void for_each(F&& f) {
+        for (handle h = 0; h < slots_.size(); ++h) {
+            if (slots_[h].id) {
+                f(h, *slots_[h].id, slots_[h].value);
+            }
+        }
+    }
+
+    template <typename F> void for_each(F&& f) const {
+        for (handle h = 0; h < slots_.size(); ++h) {
+            if (slots_[h].id) {
+                f(h, *slots_[h].id, slots_[h].value);
+            }
+        }
+    }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// timer_wheel überwacht, ob sich Einträge innerhalb von timeout gemeldet haben
+// (hashed timing wheel). Die Einträge werden über dichte Handles angesprochen,
+// wie sie slot_table vergibt.
+//
+// Ein Lebenszeichen per touch() merkt sich nur den Zeitpunkt und kostet weder
+// eine Allokation noch einen Eingriff in die Buckets. Erst wenn der Bucket eines
+// Eintrags beim periodischen advance() an der Reihe ist, wird geprüft, ob er
+// tatsächlich abgelaufen ist, und er wird sonst in den Bucket seiner neuen
+// Frist umgehängt. Abläufe werden auf granularity genau erkannt.
+class timer_wheel {
+public:
+    using clock = std::chrono::steady_clock;
+    using handle = std::uint32_t;
+
+private:
+    static constexpr handle none = std::numeric_limits<handle>::max();
+
+    clock::duration timeout_;
+    clock::duration granularity_;
+
+    // Einfach verkettete Listen pro Bucket. next_ und last_seen_ sind über das
+    // Handle indiziert, die Verkettung liegt damit in den Einträgen selbst.
+    std::vector<handle> buckets_;
+    std::vector<handle> next_ {};
+    std::vector<clock::time_point> last_seen_ {};
+    std::vector<bool> scheduled_ {};
+
+    // Letzter Tick, der bereits abgearbeitet wurde
+    std::int64_t current_;
+
+    std::int64_t tick_of(clock::time_point t) const noexcept {
+        return t.time_since_epoch() / granularity_;
+    }
+
+    // Bucket für die Frist eines Eintrags, aufgerundet auf den nächsten Tick
+    void link(handle h) {
+        auto deadline = tick_of(last_seen_[h] + timeout_ + granularity_ - clock::duration { 1 });
+        if (deadline <= current_) {
+            deadline = current_ + 1;
+        }
+        auto& bucket = buckets_[static_cast<std::size_t>(deadline) % buckets_.size()];
+        next_[h] = bucket;
+        bucket = h;
+        scheduled_[h] = true;
+    }
+
+public:
+    timer_wheel(clock::duration timeout, clock::duration granularity, clock::time_point now = clock::now())
+        : timeout_(timeout)
+        , granularity_(granularity)
+        , buckets_(static_cast<std::size_t>(timeout / granularity) + 2, none)
+        , current_(tick_of(now)) { }
+
+    clock::duration granularity() const noexcept {
+        return granularity_;
+    }
+
+    // Vermerkt ein Lebenszeichen des Eintrags h
+    void touch(handle h, clock::time_point now) {
+        if (h >= last_seen_.size()) {
+            next_.resize(h + 1, none);
+            last_seen_.resize(h + 1);
+            scheduled_.resize(h + 1, false);
+        }
+        last_seen_[h] = now;
+        if (!scheduled_[h]) {
+            link(h);
+        }
+    }
+
+    // Arbeitet alle Ticks bis now ab und ruft expire(h) für jeden Eintrag auf,
+    // der sich seit timeout nicht gemeldet hat. Der Eintrag ist danach nicht mehr
+    // eingeplant, sein Handle darf also sofort wiederverwendet werden.
+    template <typename F> void advance(clock::time_point now, F&& expire) {
+        auto target = tick_of(now);
+
+        // Nach einer langen Pause genügt eine Runde über alle Buckets
+        if (target - current_ > static_cast<std::int64_t>(buckets_.size())) {
+            current_ = target - static_cast<std::int64_t>(buckets_.size());
+        }
+
+        while (current_ < target) {
+            ++current_;
+            auto h = buckets_[static_cast<std::size_t>(current_) % buckets_.size()];
+            buckets_[static_cast<std::size_t>(current_) % buckets_.size()] = none;
+
+            while (h != none) {
+                auto next = next_[h];
+                if (now - last_seen_[h] >= timeout_) {
+                    scheduled_[h] = false;
+                    expire(h);
+                } else {
+                    link(h);
+                }
+                h = next;
+            }
+        }
+    }
+};
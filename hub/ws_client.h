@@ -0,0 +1,213 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <nlohmann/json.hpp>
+
+#include "log.h"
+
+// ws_client ist eine WebSocket-Verbindung zum Frontend mit eigener
+// Sendewarteschlange. Beast erlaubt pro Stream nur einen Schreibvorgang
+// gleichzeitig, deshalb werden alle Nachrichten in die Warteschlange gestellt
+// und von einer eigenen Writer-Coroutine nacheinander verschickt.
+//
+// Die Warteschlange ist beschränkt. Läuft sie über, gewinnt der neueste Stand:
+// Ein vollständiger Snapshot ersetzt alles, was noch in der Warteschlange liegt,
+// und bei einem Delta-Client wird die Warteschlange verworfen und stattdessen
+// ein neuer Snapshot angefordert. Hängt ein Client länger als max_lag hinterher,
+// wird die Verbindung getrennt.
+//
+// Der Stream sollte auf einem Strand laufen. send_snapshot() und send_delta()
+// dürfen von beliebigen Threads aufgerufen werden und reichen die Nachricht an
+// den Strand der Verbindung weiter.
+class ws_client : public std::enable_shared_from_this<ws_client> {
+public:
+    using stream = boost::beast::websocket::stream<boost::asio::ip::tcp::socket>;
+    using message = std::shared_ptr<const std::string>;
+
+    struct limits {
+        std::size_t max_queue;
+        std::chrono::steady_clock::duration max_lag;
+    };
+
+private:
+    stream ws_;
+    limits limits_;
+    std::deque<message> queue_ {};
+
+    // Dient als Signal für die Writer-Coroutine. Der Timer läuft nie ab, sondern
+    // wird abgebrochen, sobald eine Nachricht eingereiht wird.
+    boost::asio::steady_timer signal_;
+
+    // Zeitpunkt, seit dem der Client mit vollen Warteschlangen hinterherhängt
+    std::optional<std::chrono::steady_clock::time_point> behind_since_ {};
+
+    std::atomic<bool> closed_ { false };
+
+    // Länge von queue_ für andere Threads, etwa für die Metriken
+    std::atomic<std::size_t> queued_ { 0 };
+
+public:
+    // Im Delta-Modus bekommt der Client zuerst einen vollständigen Snapshot und
+    // danach nur noch Änderungen, sonst bei jeder Änderung den kompletten Zustand.
+    const bool delta;
+
+    // Wird gesetzt, wenn der Client beim nächsten Broadcast einen Snapshot braucht
+    std::atomic<bool> needs_snapshot { true };
+
+    ws_client(stream ws, bool delta, limits limits)
+        : ws_(std::move(ws))
+        , limits_(limits)
+        , signal_(ws_.get_executor(), std::chrono::steady_clock::time_point::max())
+        , delta(delta) { }
+
+    bool closed() const noexcept {
+        return closed_;
+    }
+
+    std::size_t queued() const noexcept {
+        return queued_.load(std::memory_order_relaxed);
+    }
+
+    // Startet die Reader- und die Writer-Coroutine
+    void start() {
+        auto executor = ws_.get_executor();
+        boost::asio::co_spawn(executor, read_loop(shared_from_this()), boost::asio::detached);
+        boost::asio::co_spawn(executor, write_loop(shared_from_this()), boost::asio::detached);
+    }
+
+    // Reiht einen Snapshot ein. Ein Snapshot enthält den kompletten Zustand und
+    // macht damit alle noch wartenden Nachrichten überflüssig.
+    void send_snapshot(message msg) {
+        boost::asio::dispatch(ws_.get_executor(),
+            [self = shared_from_this(), msg = std::move(msg)]() mutable { self->enqueue_snapshot(std::move(msg)); });
+    }
+
+    // Reiht ein Delta ein. Passt es nicht mehr in die Warteschlange, wird der
+    // Rückstand verworfen und beim nächsten Broadcast ein Snapshot geschickt.
+    void send_delta(message msg) {
+        boost::asio::dispatch(ws_.get_executor(),
+            [self = shared_from_this(), msg = std::move(msg)]() mutable { self->enqueue_delta(std::move(msg)); });
+    }
+
+private:
+    void enqueue_snapshot(message msg) {
+        if (closed_) {
+            return;
+        }
+        // Wartet noch eine ältere Nachricht hinter der gerade geschriebenen, kommt
+        // der Client nicht hinterher.
+        if (queue_.size() > 1 && check_lag()) {
+            return;
+        }
+
+        // Die vorderste Nachricht wird eventuell gerade geschrieben und muss
+        // deshalb in der Warteschlange bleiben.
+        if (!queue_.empty()) {
+            queue_.erase(std::next(queue_.begin()), queue_.end());
+        }
+        push(std::move(msg));
+    }
+
+    void enqueue_delta(message msg) {
+        if (closed_) {
+            return;
+        }
+        if (queue_.size() >= limits_.max_queue) {
+            if (check_lag()) {
+                return;
+            }
+            queue_.erase(std::next(queue_.begin()), queue_.end());
+            queued_.store(queue_.size(), std::memory_order_relaxed);
+            needs_snapshot = true;
+            return;
+        }
+        push(std::move(msg));
+    }
+
+    void close() {
+        if (closed_.exchange(true)) {
+            return;
+        }
+        signal_.cancel();
+
+        // Bricht laufende Lese- und Schreibvorgänge ab
+        boost::system::error_code ec;
+        boost::beast::get_lowest_layer(ws_).close(ec);
+    }
+
+    void push(message msg) {
+        queue_.push_back(std::move(msg));
+        queued_.store(queue_.size(), std::memory_order_relaxed);
+        signal_.cancel_one();
+    }
+
+    // Merkt sich, seit wann der Client hinterherhängt, und trennt ihn, wenn das
+    // zu lange dauert. Gibt true zurück, falls der Client getrennt wurde.
+    bool check_lag() {
+        auto now = std::chrono::steady_clock::now();
+        if (!behind_since_) {
+            behind_since_ = now;
+        } else if (now - *behind_since_ > limits_.max_lag) {
+            core::log::warning("WebSocket-Client hängt zu weit hinterher und wird getrennt");
+            close();
+            return true;
+        }
+        return false;
+    }
+
+    static boost::asio::awaitable<void> write_loop(std::shared_ptr<ws_client> self) {
+        try {
+            while (!self->closed_) {
+                if (self->queue_.empty()) {
+                    boost::system::error_code ec;
+                    co_await self->signal_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+                    continue;
+                }
+
+                // Die Nachricht bleibt während des Schreibens vorne in der Warteschlange
+                auto msg = self->queue_.front();
+                co_await self->ws_.async_write(boost::asio::buffer(*msg), boost::asio::use_awaitable);
+                self->queue_.pop_front();
+                self->queued_.store(self->queue_.size(), std::memory_order_relaxed);
+
+                if (self->queue_.empty()) {
+                    self->behind_since_.reset();
+                }
+            }
+        } catch (std::exception&) {
+        }
+        self->close();
+    }
+
+    static boost::asio::awaitable<void> read_loop(std::shared_ptr<ws_client> self) {
+        // Die einzige Nachricht, die ein Client schicken kann, ist die Bitte um
+        // einen neuen Snapshot, wenn er eine Lücke in den Sequenznummern bemerkt.
+        boost::beast::flat_buffer buf;
+        try {
+            for (;;) {
+                co_await self->ws_.async_read(buf, boost::asio::use_awaitable);
+                auto message
+                    = nlohmann::json::parse(boost::beast::buffers_to_string(buf.data()), nullptr, false);
+                buf.consume(buf.size());
+
+                if (message.is_object() && message.value("type", "") == "resync") {
+                    self->needs_snapshot = true;
+                }
+            }
+        } catch (std::exception&) {
+        }
+        self->close();
+    }
+};
@@ -0,0 +1,50 @@
+#include "control.h"
+
+#include <cstddef>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace boost::asio;
+using namespace boost::asio::ip;
+
+// Längere Zeilen werden nicht angenommen
+static constexpr std::size_t max_line = 64 * 1024;
+
+static awaitable<void> serve_connection(tcp::socket socket, std::shared_ptr<control_handler> handler) {
+    std::string buf;
+    try {
+        for (;;) {
+            auto length = co_await async_read_until(socket, dynamic_buffer(buf, max_line), '\n', use_awaitable);
+            auto line = buf.substr(0, length);
+            buf.erase(0, length);
+
+            nlohmann::json response;
+            auto request = nlohmann::json::parse(line, nullptr, false);
+            if (!request.is_object() || !request["command"].is_string()) {
+                response = { { "error", "Erwartet wird ein Objekt mit dem Feld command" } };
+            } else {
+                try {
+                    response = co_await (*handler)(request);
+                } catch (std::exception& err) {
+                    response = { { "error", err.what() } };
+                }
+            }
+
+            auto output = response.dump();
+            output += '\n';
+            co_await async_write(socket, buffer(output), use_awaitable);
+        }
+    } catch (std::exception&) {
+        // Verbindung geschlossen oder Zeile zu lang
+    }
+}
+
+awaitable<void> serve_control(tcp::acceptor acceptor, control_handler handler) {
+    auto shared = std::make_shared<control_handler>(std::move(handler));
+    for (;;) {
+        auto socket = co_await acceptor.async_accept(use_awaitable);
+        co_spawn(acceptor.get_executor(), serve_connection(std::move(socket), shared), detached);
+    }
+}
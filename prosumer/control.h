@@ -0,0 +1,19 @@
+#pragma once
+
+#include <functional>
+
+#include <boost/asio.hpp>
+#include <nlohmann/json.hpp>
+
+// Steuerschnittstelle (RPC) der Prosumer über TCP. Jede Zeile ist ein Befehl
+// in JSON, auf den genau eine Zeile JSON als Antwort folgt, z.B.
+//
+//     {"command": "list"}
+//     {"command": "set", "id": "wind-3", "name": "amp", "value": 500}
+//     {"command": "stop", "id": "wind-3"}
+//
+// Was ein Befehl bewirkt, entscheidet der Handler. Die Verbindungen laufen
+// auf dem Executor des Acceptors, die Skripte werden dabei nicht aufgehalten.
+using control_handler = std::function<boost::asio::awaitable<nlohmann::json>(const nlohmann::json&)>;
+
+boost::asio::awaitable<void> serve_control(boost::asio::ip::tcp::acceptor acceptor, control_handler handler);
@@ -0,0 +1,331 @@
+#include "fleet.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <nlohmann/json.hpp>
+
+#include "control.h"
+#include "runtime.h"
+#include "sender.h"
+#include "sim_clock.h"
+#include "trace.h"
+#include "types.h"
+
+using namespace boost::asio;
+using namespace boost::asio::ip;
+
+namespace {
+std::chrono::milliseconds seconds_to_ms(double seconds) {
+    return std::chrono::milliseconds { std::llround(seconds * 1000.0) };
+}
+} // namespace
+
+std::vector<fleet_member> load_fleet(const std::string& path, std::optional<std::uint64_t> seed) {
+    std::ifstream input { path };
+    if (!input) {
+        throw std::runtime_error { "Flotte " + path + " konnte nicht gelesen werden" };
+    }
+    auto doc = nlohmann::json::parse(input, nullptr, false);
+    if (!doc.is_object() || !doc["prosumers"].is_array()) {
+        throw std::runtime_error { "Flotte " + path + " enthält kein Array \"prosumers\"" };
+    }
+
+    std::vector<fleet_member> members;
+    std::mt19937_64 random { seed ? *seed : std::random_device {}() };
+    boost::uuids::basic_random_generator<std::mt19937_64> uuids { random };
+    for (const auto& entry : doc["prosumers"]) {
+        try {
+            auto kind = entry.value("kind", "consumer");
+            if (kind != "consumer" && kind != "producer") {
+                throw std::runtime_error { "kind muss consumer oder producer sein" };
+            }
+            bool is_consumer = kind == "consumer";
+            auto type_name = entry.value("type", is_consumer ? "personal" : "coal");
+            auto type = parse_type_name(is_consumer, type_name);
+            if (!type) {
+                throw std::runtime_error { "Typ " + type_name + " existiert nicht" };
+            }
+
+            auto x = entry.at("x").get<double>();
+            auto y = entry.at("y").get<double>();
+            if (x < 0.0 || x > 1.0 || y < 0.0 || y > 1.0) {
+                throw std::runtime_error { "Koordinaten müssen zwischen 0 und 1 liegen" };
+            }
+
+            fleet_member member {
+                .id = entry.value("id", ""),
+                .type = *type,
+                .pos_x = x,
+                .pos_y = y,
+                .script = entry.value("script", ""),
+                .args = entry.value("args", std::vector<std::string> {}),
+            };
+
+            double offset_step = 0.0;
+            if (entry.contains("trace")) {
+                if (!member.script.empty()) {
+                    throw std::runtime_error { "script und trace sind nicht kombinierbar" };
+                }
+                auto interval = entry.value("interval", 1000.0);
+                if (interval < 1.0) {
+                    throw std::runtime_error { "interval muss mindestens 1 ms betragen" };
+                }
+                member.trace = trace_replay {
+                    .path = entry.at("trace").get<std::string>(),
+                    .column = entry.value("column", ""),
+                    .offset = seconds_to_ms(entry.value("offset", 0.0)),
+                    .interval = std::chrono::milliseconds { static_cast<std::int64_t>(interval) },
+                    .scale = entry.value("scale", 1.0),
+                };
+                offset_step = entry.value("offset_step", 0.0);
+            } else if (member.script.empty()) {
+                throw std::runtime_error { "script oder trace muss angegeben werden" };
+            }
+
+            // Als vorzeichenbehaftete Zahl lesen, sonst würde aus -1 eine riesige Anzahl
+            auto count = entry.value("count", std::int64_t { 1 });
+            if (count < 1) {
+                throw std::runtime_error { "count muss mindestens 1 sein" };
+            }
+            for (std::int64_t i = 0; i < count; ++i) {
+                auto& m = members.emplace_back(member);
+                if (m.trace) {
+                    m.trace->offset += seconds_to_ms(offset_step * static_cast<double>(i));
+                }
+                if (member.id.empty()) {
+                    std::stringstream ss;
+                    ss << uuids();
+                    m.id = ss.str();
+                } else if (count > 1) {
+                    m.id += "-" + std::to_string(i);
+                }
+            }
+        } catch (std::exception& err) {
+            throw std::runtime_error { "Ungültiger Prosumer in " + path + ": " + err.what() + " (" + entry.dump()
+                + ")" };
+        }
+    }
+    return members;
+}
+
+namespace {
+// Ein Thread der Flotte mit eigenem io_context, Lua-Zustand und Socket
+struct worker {
+    io_context ctx { 1 };
+    const sim_clock& clock;
+    sender out;
+    runtime scripts;
+
+    // Läuft nie ab. Abgespielte Lastgänge warten darauf, wenn der Sender voll
+    // ist, und werden durch cancel() geweckt, sobald er wieder Platz hat.
+    steady_timer ready_signal { ctx, steady_timer::time_point::max() };
+
+    worker(const fleet_options& options, const sim_clock& clock, std::optional<std::uint64_t> seed)
+        : clock(clock)
+        , out(ctx, options.hub,
+              { options.send_queue, options.max_datagram, options.flush_interval, options.format })
+        , scripts(ctx, clock, seed) {
+        out.on_ready([this] {
+            scripts.ready();
+            ready_signal.cancel();
+        });
+    }
+};
+
+core::notification make_notification(const fleet_member& member, std::uint64_t power, std::int64_t timestamp) {
+    return {
+        .id = member.id,
+        .power = power,
+        .pos_x = member.pos_x,
+        .pos_y = member.pos_y,
+        .type = member.type,
+        .timestamp = timestamp,
+    };
+}
+
+// Spielt eine Spalte eines Lastgangs für einen Prosumer ab. Alle Prosumer
+// lesen direkt aus der gemeinsam eingeblendeten Datei, pro Prosumer kommen nur
+// diese Coroutine und ein Timer hinzu. Der Lastgang läuft in Schleife und in
+// simulierter Zeit, die Zeitstempel liegen genau im Abstand von interval.
+awaitable<void> replay(worker* w, const fleet_member* member, std::shared_ptr<const trace> source, std::size_t column) {
+    const auto& settings = *member->trace;
+    steady_timer timer { w->ctx };
+    std::chrono::milliseconds next { 0 };
+
+    for (;;) {
+        auto power = std::max(0.0, source->at(column, settings.offset + next) * settings.scale);
+        auto notification
+            = make_notification(*member, static_cast<std::uint64_t>(std::llround(power)), w->clock.timestamp(next));
+        while (!w->out.send(notification)) {
+            boost::system::error_code ec;
+            co_await w->ready_signal.async_wait(redirect_error(use_awaitable, ec));
+        }
+
+        // Hinkt der Prosumer hinterher, wird nicht nachgeholt, sondern ab jetzt weitergezählt
+        next = std::max(next + settings.interval, w->clock.elapsed());
+        timer.expires_at(w->clock.real_at(next));
+        co_await timer.async_wait(use_awaitable);
+    }
+}
+
+// Führt f(runtime&) auf dem Thread des Workers aus und liefert das Ergebnis zurück
+template <typename F> awaitable<std::invoke_result_t<F, runtime&>> run_on(worker* w, F f) {
+    co_return f(w->scripts);
+}
+
+template <typename F> auto query(worker& w, F f) {
+    return co_spawn(w.ctx, run_on(&w, std::move(f)), use_awaitable);
+}
+
+std::string_view to_string(runtime::state state) {
+    switch (state) {
+    case runtime::state::running:
+        return "running";
+    case runtime::state::sleeping:
+        return "sleeping";
+    case runtime::state::waiting:
+        return "waiting";
+    }
+    return "unknown";
+}
+
+// Beantwortet einen Befehl der Steuerschnittstelle. owner ordnet jeder
+// Prosumer-ID ihren Worker zu und wird nach dem Start nur noch gelesen.
+awaitable<nlohmann::json> handle_command(std::vector<std::unique_ptr<worker>>& pool,
+    const std::unordered_map<std::string, worker*>& owner, const nlohmann::json& request) {
+    auto command = request["command"].get<std::string>();
+
+    if (command == "list") {
+        auto prosumers = nlohmann::json::array();
+        for (auto& w : pool) {
+            for (auto& info : co_await query(*w, [](runtime& r) { return r.list(); })) {
+                prosumers.push_back({
+                    { "id", info.name },
+                    { "state", to_string(info.state) },
+                    { "notifications", info.notifications },
+                });
+            }
+        }
+        co_return nlohmann::json { { "prosumers", std::move(prosumers) } };
+    }
+
+    if (command != "set" && command != "stop") {
+        co_return nlohmann::json { { "error", "Unbekannter Befehl " + command } };
+    }
+
+    auto id = request.value("id", "");
+    auto it = owner.find(id);
+    if (it == owner.end()) {
+        co_return nlohmann::json { { "error", "Prosumer " + id + " existiert nicht" } };
+    }
+
+    bool found;
+    if (command == "stop") {
+        found = co_await query(*it->second, [&id](runtime& r) { return r.stop(id); });
+    } else {
+        auto name = request.value("name", "");
+        auto v = request.value("value", nlohmann::json {});
+        runtime::value value;
+        if (v.is_boolean()) {
+            value = v.get<bool>();
+        } else if (v.is_number()) {
+            value = v.get<lua_Number>();
+        } else if (v.is_string()) {
+            value = v.get<std::string>();
+        } else {
+            co_return nlohmann::json { { "error", "value muss ein Wahrheitswert, eine Zahl oder ein String sein" } };
+        }
+        if (name.empty()) {
+            co_return nlohmann::json { { "error", "name fehlt" } };
+        }
+        found = co_await query(*it->second, [&](runtime& r) { return r.set(id, name, value); });
+    }
+    if (!found) {
+        co_return nlohmann::json { { "error", "Das Skript von " + id + " ist bereits beendet" } };
+    }
+    co_return nlohmann::json { { "ok", true } };
+}
+} // namespace
+
+void run_fleet(const std::vector<fleet_member>& members, const fleet_options& options) {
+    auto workers = std::clamp<std::size_t>(options.workers, 1, std::max<std::size_t>(members.size(), 1));
+
+    sim_clock clock { options.speed, options.start.value_or(std::chrono::system_clock::now()) };
+
+    std::vector<std::unique_ptr<worker>> pool;
+    for (std::size_t i = 0; i < workers; ++i) {
+        std::optional<std::uint64_t> seed;
+        if (options.seed) {
+            seed = *options.seed + i;
+        }
+        pool.emplace_back(std::make_unique<worker>(options, clock, seed));
+    }
+
+    // Jeder Lastgang wird nur einmal eingeblendet und von allen Threads geteilt
+    std::unordered_map<std::string, std::shared_ptr<const trace>> traces;
+
+    // Die Prosumer werden reihum auf die Threads verteilt. Ein Handler hält nur
+    // Zeiger, damit er in den internen Puffer von std::function passt. Die
+    // Steuerschnittstelle kennt nur Prosumer mit Lua-Skript.
+    std::unordered_map<std::string, worker*> owner;
+    for (std::size_t i = 0; i < members.size(); ++i) {
+        auto& w = *pool[i % workers];
+        const auto* member = &members[i];
+
+        if (member->trace) {
+            auto& source = traces[member->trace->path];
+            if (!source) {
+                source = trace::open(member->trace->path);
+            }
+            auto column = source->find(member->trace->column);
+            if (!column) {
+                throw std::runtime_error { "Lastgang " + member->trace->path + " hat keine Spalte "
+                    + member->trace->column };
+            }
+            co_spawn(w.ctx, replay(&w, member, source, *column), detached);
+            continue;
+        }
+
+        owner.emplace(member->id, &w);
+        w.scripts.spawn(member->id, member->script, member->args,
+            [member, &w](std::uint64_t power) {
+                return w.out.send(make_notification(*member, power, w.clock.timestamp()));
+            });
+    }
+
+    if (options.control_port) {
+        auto& ctx = pool[0]->ctx;
+        tcp::acceptor acceptor { ctx, tcp::endpoint { tcp::v4(), options.control_port } };
+        co_spawn(ctx,
+            serve_control(std::move(acceptor),
+                [&pool, &owner](const nlohmann::json& request) { return handle_command(pool, owner, request); }),
+            detached);
+    }
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < workers; ++i) {
+        threads.emplace_back([&ctx = pool[i]->ctx] { ctx.run(); });
+    }
+    pool[0]->ctx.run();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
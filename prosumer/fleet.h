@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "models.h"
+
+// Spielt eine Spalte eines aufgezeichneten Lastgangs (siehe trace.h) ab, statt
+// die Werte mit einem Lua-Skript zu berechnen
+struct trace_replay {
+    std::string path;
+
+    // Name der Spalte, leer für die erste Spalte
+    std::string column;
+
+    // Startpunkt im Lastgang, damit gleiche Prosumer nicht im Gleichschritt laufen
+    std::chrono::milliseconds offset { 0 };
+
+    // Abstand der Benachrichtigungen
+    std::chrono::milliseconds interval { 1000 };
+
+    // Faktor für die Werte, z.B. wenn der Lastgang in Kilowatt vorliegt
+    double scale { 1.0 };
+};
+
+// Ein simulierter Prosumer im Flottenmodus. Er führt entweder ein Lua-Skript
+// aus oder spielt einen Lastgang ab.
+struct fleet_member {
+    std::string id;
+    decltype(core::notification::type) type;
+    double pos_x;
+    double pos_y;
+    std::string script;
+    std::vector<std::string> args;
+    std::optional<trace_replay> trace;
+};
+
+// Liest die Flotte aus einer JSON-Datei der Form
+//
+//     { "prosumers": [
+//         { "id": "wind", "kind": "producer", "type": "wind", "x": 0.2, "y": 0.7,
+//           "script": "scripts/wave.lua", "args": ["500", "200"], "count": 1000 },
+//         { "id": "haushalt", "x": 0.4, "y": 0.3, "trace": "last.trace", "column": "h0",
+//           "offset": 0, "offset_step": 900, "interval": 1000, "scale": 1.0, "count": 1000 }
+//     ] }
+//
+// Mit count entstehen mehrere gleiche Prosumer mit den IDs wind-0, wind-1, ...
+// Bei Lastgängen beginnt jeder davon offset_step Sekunden später im Lastgang
+// als sein Vorgänger, offset gibt den Startpunkt des ersten in Sekunden an.
+// Fehlt die ID, bekommt jeder Prosumer eine zufällige UUID, mit seed immer
+// dieselbe. Bei Fehlern in der Datei wird eine std::runtime_error geworfen.
+std::vector<fleet_member> load_fleet(const std::string& path, std::optional<std::uint64_t> seed = std::nullopt);
+
+struct fleet_options {
+    // Anzahl der Threads, jeder mit eigenem Lua-Zustand und eigenem UDP-Socket
+    std::size_t workers { 1 };
+    boost::asio::ip::udp::endpoint hub { boost::asio::ip::address_v4::loopback(), 3000 };
+    core::wire_format format { core::wire_format::json };
+
+    // Datagramme, die pro Thread auf den Versand warten dürfen, bevor notify() wartet
+    std::size_t send_queue { 1024 };
+
+    // Benachrichtigungen eines Threads werden bis zu flush_interval gesammelt
+    // und als Stapel von höchstens max_datagram Bytes verschickt. 1472 Bytes
+    // passen mit IPv4- und UDP-Header in eine Ethernet-MTU von 1500 Bytes. Ein
+    // flush_interval von 0 verschickt jede Benachrichtigung einzeln.
+    std::chrono::milliseconds flush_interval { 100 };
+    std::size_t max_datagram { 1472 };
+
+    // TCP-Port der Steuerschnittstelle, 0 schaltet sie ab
+    unsigned short control_port { 0 };
+
+    // Die simulierte Zeit läuft speed-mal so schnell wie die echte und beginnt
+    // bei start, ohne start beim Aufruf von run_fleet (siehe sim_clock)
+    double speed { 1.0 };
+    std::optional<std::chrono::system_clock::time_point> start {};
+
+    // Macht Zufallszahlen der Skripte reproduzierbar, jeder Thread bekommt
+    // seed + seine Nummer. Gleiche Läufe setzen also auch gleich viele Threads voraus.
+    std::optional<std::uint64_t> seed {};
+};
+
+// Führt alle Prosumer der Flotte aus, bis alle Skripte beendet sind. Mit
+// Steuerschnittstelle oder abgespielten Lastgängen läuft der Prozess weiter,
+// bis er beendet wird.
+void run_fleet(const std::vector<fleet_member>& members, const fleet_options& options);
@@ -1,9 +1,15 @@
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <ctime>
 #include <exception>
 #include <iostream>
+#include <optional>
+#include <random>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -14,8 +20,10 @@
 #include <boost/uuid/uuid_io.hpp>
 #include <cxxopts.hpp>
 
+#include "fleet.h"
 #include "models.h"
-#include "script.h"
+#include "trace.h"
+#include "types.h"
 
 using namespace boost::asio;
 using namespace boost::asio::ip;
@@ -42,53 +50,61 @@ auto parse_type(cxxopts::ParseResult& result, bool is_consumer) {
         }
     } else {
         auto type_str = result["type"].as<std::string>();
-        if (is_consumer) {
-            static std::unordered_map<std::string_view, core::consumer_type> consumer_types {
-                { "personal", core::consumer_type::personal },
-                { "industrial", core::consumer_type::industrial },
-            };
-            if (!consumer_types.contains(type_str)) {
-                std::cerr << "Consumer-Typ " << type_str << " existiert nicht!" << std::endl;
-                exit(1);
-            }
-            type = consumer_types[type_str];
-        } else {
-            static std::unordered_map<std::string_view, core::producer_type> producer_types {
-                { "coal", core::producer_type::coal },
-                { "nuclear", core::producer_type::nuclear },
-                { "solar", core::producer_type::solar },
-                { "water", core::producer_type::water },
-                { "wind", core::producer_type::wind },
-            };
-            if (!producer_types.contains(type_str)) {
-                std::cerr << "Producer-Typ " << type_str << " existiert nicht!" << std::endl;
-                exit(1);
-            }
-            type = producer_types[type_str];
+        auto parsed = parse_type_name(is_consumer, type_str);
+        if (!parsed) {
+            std::cerr << (is_consumer ? "Consumer" : "Producer") << "-Typ " << type_str << " existiert nicht!"
+                      << std::endl;
+            exit(1);
         }
+        type = *parsed;
     }
     return type;
 }
 
-script parse_script(cxxopts::ParseResult& result) {
+std::string parse_script(cxxopts::ParseResult& result) {
     if (!result.count("script")) {
         std::cerr << "Es wurde kein Lua-Skript angegeben!" << std::endl;
         exit(1);
     }
-    auto script_path = result["script"].as<std::string>();
-    return { script_path };
+    return result["script"].as<std::string>();
+}
+
+std::vector<std::string> parse_script_args(cxxopts::ParseResult& result) {
+    if (!result.count("arg")) {
+        return {};
+    }
+    return result["arg"].as<std::vector<std::string>>();
 }
 
-void load_script_args(cxxopts::ParseResult& result, script& s) {
-    auto script_args = result["arg"].as<std::vector<std::string>>();
-    s.load_arguments(script_args);
+trace_replay parse_trace(cxxopts::ParseResult& result) {
+    if (result.count("script")) {
+        std::cerr << "-s,--script und --trace sind nicht kombinierbar!" << std::endl;
+        exit(1);
+    }
+    auto interval = result["trace-interval"].as<unsigned int>();
+    if (interval == 0) {
+        std::cerr << "--trace-interval muss mindestens 1 ms betragen!" << std::endl;
+        exit(1);
+    }
+    return {
+        .path = result["trace"].as<std::string>(),
+        .column = result.count("trace-column") ? result["trace-column"].as<std::string>() : "",
+        .offset = std::chrono::milliseconds { std::llround(result["trace-offset"].as<double>() * 1000.0) },
+        .interval = std::chrono::milliseconds { interval },
+        .scale = result["trace-scale"].as<double>(),
+    };
 }
 
-auto parse_prosumer_id(cxxopts::ParseResult& result) {
+// Ohne --id gibt es eine zufällige UUID, mit seed wie in load_fleet() immer dieselbe
+auto parse_prosumer_id(cxxopts::ParseResult& result, std::optional<std::uint64_t> seed) {
     if (!result.count("id")) {
-        auto uuid = boost::uuids::random_generator()();
         std::stringstream ss;
-        ss << uuid;
+        if (seed) {
+            std::mt19937_64 random { *seed };
+            ss << boost::uuids::basic_random_generator<std::mt19937_64> { random }();
+        } else {
+            ss << boost::uuids::random_generator()();
+        }
         return ss.str();
     }
     return result["id"].as<std::string>();
@@ -108,6 +124,22 @@ auto parse_position(cxxopts::ParseResult& result) {
     return std::make_pair(x, y);
 }
 
+auto parse_wire_format(cxxopts::ParseResult& result) {
+    if (!result.count("format")) {
+        return core::wire_format::json;
+    }
+    static std::unordered_map<std::string_view, core::wire_format> wire_formats {
+        { "json", core::wire_format::json },
+        { "binary", core::wire_format::binary },
+    };
+    auto format_str = result["format"].as<std::string>();
+    if (!wire_formats.contains(format_str)) {
+        std::cerr << "Format " << format_str << " existiert nicht!" << std::endl;
+        exit(1);
+    }
+    return wire_formats[format_str];
+}
+
 int main(int argc, char** argv) {
     static cxxopts::Options options { "prosumer", "Producer und Consumer in einem Programm" };
     // clang-format off
@@ -120,6 +152,34 @@ int main(int argc, char** argv) {
         ("Y", "Y-Position", cxxopts::value<double>())
         ("s,script", "Lua-Skript", cxxopts::value<std::string>())
         ("a,arg", "Lua-Skript Argument", cxxopts::value<std::vector<std::string>>())
+        ("trace", "Lastgang, der statt eines Lua-Skripts abgespielt wird", cxxopts::value<std::string>())
+        ("trace-column", "Spalte des Lastgangs (Standard: die erste)", cxxopts::value<std::string>())
+        ("trace-offset", "Startpunkt im Lastgang in Sekunden", cxxopts::value<double>()->default_value("0"))
+        ("trace-interval", "Millisekunden zwischen zwei Benachrichtigungen aus dem Lastgang",
+            cxxopts::value<unsigned int>()->default_value("1000"))
+        ("trace-scale", "Faktor für die Werte des Lastgangs", cxxopts::value<double>()->default_value("1"))
+        ("convert-trace", "Wandelt eine CSV-Datei in den unter --trace angegebenen Lastgang um und beendet sich",
+            cxxopts::value<std::string>())
+        ("sample-interval", "Abstand der Werte im umgewandelten Lastgang in Millisekunden (0 = wie in der CSV-Datei)",
+            cxxopts::value<unsigned int>()->default_value("0"))
+        ("F,format", "Übertragungsformat (json oder binary)", cxxopts::value<std::string>())
+        ("fleet", "JSON-Datei mit vielen Prosumern, die gemeinsam in diesem Prozess laufen",
+            cxxopts::value<std::string>())
+        ("w,workers", "Anzahl der Threads im Flottenmodus (0 = Anzahl der Kerne)",
+            cxxopts::value<unsigned int>()->default_value("0"))
+        ("send-queue", "Datagramme pro Thread, die auf den Versand warten dürfen, bevor notify() wartet",
+            cxxopts::value<std::size_t>()->default_value("1024"))
+        ("flush-interval", "Millisekunden, die Benachrichtigungen für einen Stapel gesammelt werden (0 = einzeln senden)",
+            cxxopts::value<unsigned int>()->default_value("100"))
+        ("datagram-size", "Maximale Größe eines Stapels in Bytes",
+            cxxopts::value<std::size_t>()->default_value("1472"))
+        ("control", "TCP-Port der Steuerschnittstelle (0 = aus)",
+            cxxopts::value<unsigned short>()->default_value("0"))
+        ("speed", "Faktor, um den die simulierte Zeit schneller als die echte läuft",
+            cxxopts::value<double>()->default_value("1"))
+        ("sim-start", "Beginn der simulierten Zeit als Unix-Zeit in Sekunden (Standard: jetzt)",
+            cxxopts::value<std::int64_t>())
+        ("seed", "Startwert für reproduzierbare Zufallszahlen und IDs", cxxopts::value<std::uint64_t>())
         ("h,help", "Hilfe-Seite anzeigen");
     // clang-format on
     auto result = options.parse(argc, argv);
@@ -129,34 +189,78 @@ int main(int argc, char** argv) {
         exit(0);
     }
 
-    bool is_consumer = parse_consumer_producer(result);
-    auto type = parse_type(result, is_consumer);
-    auto s = parse_script(result);
-    load_script_args(result, s);
-    auto prosumer_id = parse_prosumer_id(result);
-    double x, y;
-    std::tie(x, y) = parse_position(result);
-
-    io_context ctx { 1 };
-    udp::endpoint endpoint { address::from_string("127.0.0.1"), 3000 };
-    auto socket = udp::socket { ctx };
-    socket.open(udp::v4());
-    s.set_notify_handler([&](std::uint64_t power) {
-        auto now = std::chrono::system_clock::now();
-        auto unix_timestamp = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-
-        core::notification notification {
-            .id = prosumer_id,
-            .power = power,
+    if (result.count("convert-trace")) {
+        if (!result.count("trace")) {
+            std::cerr << "Mit --convert-trace muss --trace die Zieldatei angeben!" << std::endl;
+            exit(1);
+        }
+        try {
+            convert_trace(result["convert-trace"].as<std::string>(), result["trace"].as<std::string>(),
+                std::chrono::milliseconds { result["sample-interval"].as<unsigned int>() });
+        } catch (std::exception& err) {
+            std::cerr << err.what() << std::endl;
+            exit(1);
+        }
+        exit(0);
+    }
+
+    fleet_options fleet {
+        .workers = 1,
+        .hub = { address::from_string("127.0.0.1"), 3000 },
+        .format = parse_wire_format(result),
+        .send_queue = std::max<std::size_t>(result["send-queue"].as<std::size_t>(), 1),
+        .flush_interval = std::chrono::milliseconds { result["flush-interval"].as<unsigned int>() },
+        .max_datagram = result["datagram-size"].as<std::size_t>(),
+        .control_port = result["control"].as<unsigned short>(),
+        .speed = result["speed"].as<double>(),
+    };
+    if (!(fleet.speed > 0.0)) {
+        std::cerr << "--speed muss größer als 0 sein!" << std::endl;
+        exit(1);
+    }
+    if (result.count("sim-start")) {
+        fleet.start = std::chrono::system_clock::time_point { std::chrono::seconds {
+            result["sim-start"].as<std::int64_t>() } };
+    }
+    if (result.count("seed")) {
+        fleet.seed = result["seed"].as<std::uint64_t>();
+    }
+
+    std::vector<fleet_member> members;
+    if (result.count("fleet")) {
+        try {
+            members = load_fleet(result["fleet"].as<std::string>(), fleet.seed);
+        } catch (std::exception& err) {
+            std::cerr << err.what() << std::endl;
+            exit(1);
+        }
+        fleet.workers = result["workers"].as<unsigned int>();
+        if (fleet.workers == 0) {
+            fleet.workers = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+    } else {
+        // Ein einzelner Prosumer ist eine Flotte mit nur einem Mitglied
+        bool is_consumer = parse_consumer_producer(result);
+        auto type = parse_type(result, is_consumer);
+        auto [x, y] = parse_position(result);
+        auto& member = members.emplace_back(fleet_member {
+            .id = parse_prosumer_id(result, fleet.seed),
+            .type = type,
             .pos_x = x,
             .pos_y = y,
-            .type = type,
-            .timestamp = unix_timestamp,
-        };
-        auto str = notification.encode();
-
-        socket.send_to(buffer(str), endpoint);
-    });
+        });
+        if (result.count("trace")) {
+            member.trace = parse_trace(result);
+        } else {
+            member.script = parse_script(result);
+            member.args = parse_script_args(result);
+        }
+    }
 
-    s.run();
+    try {
+        run_fleet(members, fleet);
+    } catch (std::exception& err) {
+        std::cerr << err.what() << std::endl;
+        exit(1);
+    }
 }
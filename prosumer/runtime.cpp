@@ -0,0 +1,285 @@
+#include "runtime.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+// Längere Pausen werden auf diese simulierte Dauer gekürzt
+constexpr double max_sleep_ms = 365.0 * 24 * 60 * 60 * 1000;
+
+// Größte Leistung, die notify() verschickt. Das ist die größte Zahl unter
+// 2^64, die als double darstellbar ist, größere Werte passen nicht in einen
+// std::uint64_t.
+constexpr double max_power = 18446744073709549568.0;
+} // namespace
+
+runtime::runtime(boost::asio::io_context& ctx, const sim_clock& clock, std::optional<std::uint64_t> seed)
+    : ctx_(ctx)
+    , clock_(clock)
+    , seed_(seed ? *seed : std::random_device {}()) {
+    L_ = luaL_newstate();
+    if (!L_) {
+        throw std::runtime_error { "Lua-Zustand konnte nicht angelegt werden" };
+    }
+    // Threads, die nicht zu einem Skript gehören (z.B. eigene Coroutinen eines
+    // Skripts), erben diesen Wert und werden so erkannt
+    *static_cast<task**>(lua_getextraspace(L_)) = nullptr;
+
+    luaL_openlibs(L_);
+
+    // Ohne seed würfelt Lua den Startwert von math.random selbst aus
+    if (seed) {
+        lua_getglobal(L_, "math");
+        lua_getfield(L_, -1, "randomseed");
+        lua_pushinteger(L_, static_cast<lua_Integer>(*seed));
+        lua_call(L_, 1, 0);
+        lua_pop(L_, 1);
+    }
+
+    lua_register(L_, "sleep", runtime::sleep);
+    lua_register(L_, "notify", runtime::notify);
+}
+
+runtime::~runtime() noexcept {
+    // Zuerst die Timer, ihre Handler greifen auf die Lua-Threads zu
+    tasks_.clear();
+    lua_close(L_);
+}
+
+const std::string& runtime::source(const std::string& path) {
+    auto it = sources_.find(path);
+    if (it != sources_.end()) {
+        return it->second;
+    }
+    std::ifstream input { path, std::ios::binary };
+    if (!input) {
+        throw std::runtime_error { "Lua-Skript " + path + " konnte nicht gelesen werden" };
+    }
+    std::string code { std::istreambuf_iterator<char>(input), {} };
+    return sources_.emplace(path, std::move(code)).first->second;
+}
+
+void runtime::spawn(
+    std::string name, const std::string& path, const std::vector<std::string>& args, notify_handler handler) {
+    if (by_name_.find(name) != by_name_.end()) {
+        throw std::runtime_error { "Prosumer " + name + " existiert bereits" };
+    }
+    const auto& code = source(path);
+
+    auto& t = tasks_.emplace_back(this, std::move(name), std::move(handler), ctx_);
+    auto it = std::prev(tasks_.end());
+    t.self = it;
+    by_name_.emplace(t.name, it);
+
+    // Der Thread bleibt über die Registry am Leben, solange das Skript läuft
+    t.thread = lua_newthread(L_);
+    t.thread_ref = luaL_ref(L_, LUA_REGISTRYINDEX);
+    *static_cast<task**>(lua_getextraspace(t.thread)) = &t;
+
+    auto chunk_name = "@" + path;
+    if (luaL_loadbuffer(t.thread, code.data(), code.size(), chunk_name.c_str()) != LUA_OK) {
+        std::string message = lua_tostring(t.thread, -1);
+        finish(it);
+        throw std::runtime_error { "Lua-Fehler: " + message };
+    }
+
+    // Eigene Umgebung, die alles, was sie nicht selbst kennt, in _G nachschlägt
+    lua_newtable(t.thread);
+    lua_newtable(t.thread);
+    lua_pushglobaltable(t.thread);
+    lua_setfield(t.thread, -2, "__index");
+    lua_setmetatable(t.thread, -2);
+
+    lua_createtable(t.thread, static_cast<int>(args.size()), 0);
+    lua_Integer arg_index = 1;
+    for (const auto& arg : args) {
+        lua_pushstring(t.thread, arg.c_str());
+        lua_rawseti(t.thread, -2, arg_index++);
+    }
+    lua_setfield(t.thread, -2, "arg");
+
+    // FNV-1a über den Namen, damit jedes Skript einen eigenen, festen Startwert bekommt
+    auto script_seed = seed_ ^ 0xcbf29ce484222325;
+    for (unsigned char c : t.name) {
+        script_seed = (script_seed ^ c) * 0x100000001b3;
+    }
+    lua_pushinteger(t.thread, static_cast<lua_Integer>(script_seed));
+    lua_setfield(t.thread, -2, "seed");
+
+    // Für set() wird die Umgebung zusätzlich in der Registry gehalten
+    lua_pushvalue(t.thread, -1);
+    t.env_ref = luaL_ref(t.thread, LUA_REGISTRYINDEX);
+
+    // Das erste Upvalue eines geladenen Chunks ist immer _ENV
+    lua_setupvalue(t.thread, -2, 1);
+
+    schedule(it, std::chrono::milliseconds { 0 });
+}
+
+// Jede Fortsetzung läuft über den Timer des Skripts. Wird das Skript
+// vorher beendet, bricht der Timer ab, und der Handler fasst nichts mehr an.
+// delay ist simulierte Zeit und wird hier in echte Zeit umgerechnet.
+void runtime::schedule(iterator it, std::chrono::milliseconds delay) {
+    it->timer.expires_after(clock_.real(delay));
+    it->timer.async_wait([this, it](boost::system::error_code ec) {
+        if (!ec) {
+            resume(it);
+        }
+    });
+}
+
+void runtime::resume(iterator it) {
+    auto& t = *it;
+    t.state = state::running;
+
+    int results = 0;
+    auto status = lua_resume(t.thread, L_, 0, &results);
+    if (status == LUA_YIELD) {
+        lua_pop(t.thread, results);
+        switch (t.state) {
+        case state::sleeping:
+            schedule(it, t.delay);
+            break;
+        case state::waiting:
+            // Geht weiter, sobald ready() aufgerufen wird
+            break;
+        case state::running:
+            // coroutine.yield() direkt im Skript gibt nur den Thread kurz ab
+            schedule(it, std::chrono::milliseconds { 0 });
+            break;
+        }
+        return;
+    }
+
+    if (status != LUA_OK) {
+        std::cerr << "Skript von " << t.name << " abgebrochen: " << lua_tostring(t.thread, -1) << std::endl;
+    }
+    finish(it);
+}
+
+void runtime::ready() {
+    auto waiting = std::move(waiting_);
+    waiting_.clear();
+    for (auto it : waiting) {
+        schedule(it, std::chrono::milliseconds { 0 });
+    }
+}
+
+bool runtime::set(std::string_view name, const std::string& key, const value& v) {
+    auto found = by_name_.find(name);
+    if (found == by_name_.end()) {
+        return false;
+    }
+    lua_rawgeti(L_, LUA_REGISTRYINDEX, found->second->env_ref);
+    std::visit(
+        [this](const auto& v) {
+            using T = std::decay_t<decltype(v)>;
+            if constexpr (std::is_same_v<T, bool>) {
+                lua_pushboolean(L_, v);
+            } else if constexpr (std::is_same_v<T, lua_Number>) {
+                lua_pushnumber(L_, v);
+            } else {
+                lua_pushlstring(L_, v.data(), v.size());
+            }
+        },
+        v);
+    lua_setfield(L_, -2, key.c_str());
+    lua_pop(L_, 1);
+    return true;
+}
+
+bool runtime::stop(std::string_view name) {
+    auto found = by_name_.find(name);
+    if (found == by_name_.end()) {
+        return false;
+    }
+    auto it = found->second;
+    waiting_.erase(std::remove(waiting_.begin(), waiting_.end(), it), waiting_.end());
+    finish(it);
+    return true;
+}
+
+std::vector<runtime::info> runtime::list() const {
+    std::vector<info> result;
+    result.reserve(tasks_.size());
+    for (const auto& t : tasks_) {
+        result.push_back({ t.name, t.state, t.notifications });
+    }
+    return result;
+}
+
+void runtime::finish(iterator it) {
+    luaL_unref(L_, LUA_REGISTRYINDEX, it->thread_ref);
+    luaL_unref(L_, LUA_REGISTRYINDEX, it->env_ref);
+    by_name_.erase(it->name);
+    tasks_.erase(it);
+}
+
+runtime::task* runtime::task_of(lua_State* L) {
+    return *static_cast<task**>(lua_getextraspace(L));
+}
+
+int runtime::sleep(lua_State* L) {
+    auto ms = luaL_checknumber(L, 1);
+    if (!std::isfinite(ms) || ms < 0) {
+        return luaL_argerror(L, 1, "Dauer muss eine endliche, nicht negative Zahl sein");
+    }
+    auto* t = task_of(L);
+    if (!t || !lua_isyieldable(L)) {
+        return luaL_error(L, "sleep() ist nur im Hauptteil eines Skripts möglich");
+    }
+    t->delay = std::chrono::milliseconds { static_cast<std::int64_t>(std::min(ms, max_sleep_ms)) };
+    t->state = state::sleeping;
+    return lua_yieldk(L, 0, 0, sleep_done);
+}
+
+int runtime::sleep_done(lua_State*, int, lua_KContext) {
+    return 0;
+}
+
+int runtime::notify(lua_State* L) {
+    if (!std::isfinite(luaL_checknumber(L, 1))) {
+        return luaL_argerror(L, 1, "Leistung muss eine endliche Zahl sein");
+    }
+    return notify_retry(L, LUA_OK, 0);
+}
+
+// Nach einem lua_yieldk geht es hier weiter, das Argument liegt noch auf dem Stack
+int runtime::notify_retry(lua_State* L, int, lua_KContext) {
+    auto power = lua_tonumber(L, 1);
+    auto* t = task_of(L);
+    if (!t) {
+        return luaL_error(L, "notify() ist nur im Hauptteil eines Skripts möglich");
+    }
+
+    // Eine Exception darf nicht durch Lua hindurch, sie wird zu einem Lua-Fehler
+    char message[256];
+    try {
+        // Negative Werte werden wie bei abgespielten Lastgängen zu 0
+        if (t->notify(static_cast<std::uint64_t>(std::clamp(power, 0.0, max_power)))) {
+            ++t->notifications;
+            return 0;
+        }
+        message[0] = '\0';
+    } catch (std::exception& err) {
+        std::snprintf(message, sizeof(message), "%s", err.what());
+    }
+    if (message[0] != '\0') {
+        return luaL_error(L, "%s", message);
+    }
+
+    if (!lua_isyieldable(L)) {
+        return luaL_error(L, "notify() kann hier nicht warten");
+    }
+    t->state = state::waiting;
+    t->owner->waiting_.push_back(t->self);
+    return lua_yieldk(L, 0, 0, notify_retry);
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <lua.hpp>
+
+#include "sim_clock.h"
+
+// runtime führt viele Lua-Skripte in einem gemeinsamen lua_State aus. Jedes
+// Skript läuft als eigene Lua-Coroutine (lua_newthread) mit eigener Umgebung
+// (_ENV), globale Variablen eines Skripts sieht also kein anderes. Ein Skript
+// kostet damit nur einen Lua-Thread, eine Tabelle und einen Timer statt eines
+// eigenen Prozesses.
+//
+// Nichts, was ein Skript aufruft, blockiert den Thread. sleep() und notify()
+// halten bei Bedarf nur die Coroutine per lua_yieldk an, der Thread arbeitet
+// solange andere Skripte und Steuerbefehle ab:
+//   - sleep() setzt die Coroutine über einen steady_timer fort. Die Dauer
+//     gilt in simulierter Zeit (siehe sim_clock). Eine negative oder nicht
+//     endliche Dauer ist ein Lua-Fehler, mehr als ein Jahr wird gekürzt.
+//   - notify() übergibt den Wert an den notify_handler. Lehnt der ab, weil
+//     seine Warteschlange voll ist, wartet das Skript, bis ready() aufgerufen
+//     wird, und versucht es dann erneut.
+//
+// Mit einem seed werden math.random und die globale Variable seed, die jedes
+// Skript erhält, reproduzierbar. seed unterscheidet sich von Skript zu Skript
+// und hängt nur vom seed des runtime und dem Namen des Skripts ab, math.random
+// teilen sich dagegen alle Skripte eines runtime.
+//
+// Ein runtime gehört zu genau einem io_context und darf nur von dem Thread
+// benutzt werden, der diesen ausführt.
+class runtime {
+public:
+    // Liefert false, falls der Wert gerade nicht angenommen werden kann
+    using notify_handler = std::function<bool(std::uint64_t)>;
+
+    using value = std::variant<bool, lua_Number, std::string>;
+
+    enum class state { running, sleeping, waiting };
+
+    struct info {
+        std::string name;
+        runtime::state state;
+        std::uint64_t notifications;
+    };
+
+    runtime(boost::asio::io_context& ctx, const sim_clock& clock, std::optional<std::uint64_t> seed = std::nullopt);
+    ~runtime() noexcept;
+
+    runtime(const runtime&) = delete;
+    runtime& operator=(const runtime&) = delete;
+
+    // Lädt das Skript und startet es, sobald der io_context läuft. Der Name
+    // muss eindeutig sein. Fehler beim Laden werden als Exception gemeldet,
+    // Fehler zur Laufzeit beenden nur das eine Skript.
+    void spawn(std::string name, const std::string& path, const std::vector<std::string>& args,
+        notify_handler handler);
+
+    // Setzt die Skripte fort, die in notify() auf Platz warten
+    void ready();
+
+    // Setzt eine globale Variable in der Umgebung eines Skripts. Das Skript
+    // sieht den neuen Wert, sobald es das nächste Mal weiterläuft.
+    bool set(std::string_view name, const std::string& key, const value& v);
+
+    // Beendet ein Skript, egal ob es gerade schläft oder wartet
+    bool stop(std::string_view name);
+
+    std::vector<info> list() const;
+
+    // Anzahl der Skripte, die noch laufen
+    std::size_t size() const noexcept {
+        return tasks_.size();
+    }
+
+private:
+    struct task {
+        runtime* owner;
+        std::list<task>::iterator self {};
+        std::string name;
+        notify_handler notify;
+        boost::asio::steady_timer timer;
+        lua_State* thread { nullptr };
+        int thread_ref { LUA_NOREF };
+        int env_ref { LUA_NOREF };
+        runtime::state state { state::running };
+        std::uint64_t notifications { 0 };
+
+        // Von sleep() gesetzt, bevor die Coroutine anhält, in simulierter Zeit
+        std::chrono::milliseconds delay { 0 };
+
+        task(runtime* owner, std::string name, notify_handler notify, boost::asio::io_context& ctx)
+            : owner(owner)
+            , name(std::move(name))
+            , notify(std::move(notify))
+            , timer(ctx) { }
+    };
+
+    using iterator = std::list<task>::iterator;
+
+    boost::asio::io_context& ctx_;
+    const sim_clock& clock_;
+    std::uint64_t seed_;
+    lua_State* L_;
+
+    // Quelltext der Skripte, jede Datei wird nur einmal gelesen
+    std::unordered_map<std::string, std::string> sources_ {};
+
+    // Eine list, damit Iteratoren und Zeiger beim Einfügen und Entfernen gültig bleiben
+    std::list<task> tasks_ {};
+    std::unordered_map<std::string_view, iterator> by_name_ {};
+
+    // Skripte, deren notify() abgelehnt wurde, in der Reihenfolge ihres Versuchs
+    std::vector<iterator> waiting_ {};
+
+    const std::string& source(const std::string& path);
+    void schedule(iterator it, std::chrono::milliseconds delay);
+    void resume(iterator it);
+    void finish(iterator it);
+
+    static task* task_of(lua_State* L);
+    static int sleep(lua_State* L);
+    static int sleep_done(lua_State* L, int status, lua_KContext ctx);
+    static int notify(lua_State* L);
+    static int notify_retry(lua_State* L, int status, lua_KContext ctx);
+};
@@ -1,20 +1,33 @@
-if #arg ~= 2 then
+if #arg ~= 2 and #arg ~= 3 then
     error("Ein oder beide Argumente sind leer")
 end
-local offset = tonumber(arg[1])
-local amp = tonumber(arg[2])
+-- offset und amp sind global, damit sie sich über die Steuerschnittstelle im
+-- laufenden Betrieb ändern lassen
+offset = tonumber(arg[1])
+amp = tonumber(arg[2])
 if offset == nil then
     error("offset ist keine Zahl")
 end
 if amp == nil then
     error("amplitude ist keine Zahl")
 end
+-- Optional endet das Skript nach so vielen Benachrichtigungen, sonst nie
+local steps = math.huge
+if arg[3] ~= nil then
+    steps = tonumber(arg[3])
+    if steps == nil then
+        error("steps ist keine Zahl")
+    end
+end
 local radstep = 0.1
 local rads = 0
 
-while true do
+while steps > 0 do
     local val = ((math.sin(rads)) * amp + offset)
     rads = rads + radstep
     notify(val)
-    sleep(1000)
+    steps = steps - 1
+    if steps > 0 then
+        sleep(1000)
+    end
 end
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+#include "models.h"
+
+// sender verschickt Benachrichtigungen über einen UDP-Socket, ohne den Thread
+// zu blockieren. send() stellt die Datagramme nur in eine beschränkte
+// Warteschlange, eine Coroutine verschickt sie nacheinander mit async_send_to.
+// Ist die Warteschlange voll, lehnt send() ab. Sobald sie wieder zur Hälfte
+// geleert ist, wird der ready-Handler aufgerufen.
+//
+// Mit einem flush_interval über 0 werden die Benachrichtigungen zu Stapeln von
+// höchstens max_datagram Bytes zusammengefasst. Ein Stapel geht raus, sobald er
+// voll ist, spätestens aber flush_interval nach seiner ersten Benachrichtigung.
+//
+// Wie der runtime gehört ein sender zu genau einem io_context.
+class sender {
+public:
+    struct options {
+        std::size_t capacity;
+        std::size_t max_datagram;
+        std::chrono::milliseconds flush_interval;
+        core::wire_format format;
+    };
+
+private:
+    boost::asio::ip::udp::socket socket_;
+    boost::asio::ip::udp::endpoint target_;
+    options options_;
+    core::batch_writer batch_;
+    boost::asio::steady_timer flush_timer_;
+    bool flush_pending_ { false };
+    std::deque<std::string> queue_ {};
+    std::function<void()> ready_ {};
+    bool sending_ { false };
+    bool full_ { false };
+
+public:
+    sender(boost::asio::io_context& ctx, boost::asio::ip::udp::endpoint target, options options)
+        : socket_(ctx, boost::asio::ip::udp::v4())
+        , target_(std::move(target))
+        , options_(options)
+        , batch_(options.format)
+        , flush_timer_(ctx) { }
+
+    template <typename Handler> void on_ready(Handler&& handler) {
+        ready_ = std::forward<Handler>(handler);
+    }
+
+    bool send(const core::notification& notification) {
+        if (options_.flush_interval.count() == 0) {
+            if (queue_full()) {
+                return false;
+            }
+            enqueue(notification.encode(options_.format));
+            return true;
+        }
+
+        if (!batch_.append(notification, options_.max_datagram)) {
+            // Der Stapel ist voll und muss erst in die Warteschlange
+            if (queue_full()) {
+                return false;
+            }
+            enqueue(batch_.take());
+            batch_.append(notification, options_.max_datagram);
+        }
+        if (!flush_pending_) {
+            flush_pending_ = true;
+            flush_timer_.expires_after(options_.flush_interval);
+            flush_timer_.async_wait([this](boost::system::error_code ec) {
+                if (ec) {
+                    return;
+                }
+                flush_pending_ = false;
+                if (!batch_.empty()) {
+                    enqueue(batch_.take());
+                }
+            });
+        }
+        return true;
+    }
+
+    std::size_t queued() const noexcept {
+        return queue_.size();
+    }
+
+private:
+    bool queue_full() {
+        if (queue_.size() >= options_.capacity) {
+            full_ = true;
+        }
+        return full_;
+    }
+
+    void enqueue(std::string datagram) {
+        queue_.push_back(std::move(datagram));
+        if (!sending_) {
+            sending_ = true;
+            boost::asio::co_spawn(socket_.get_executor(), run(this), boost::asio::detached);
+        }
+    }
+
+    static boost::asio::awaitable<void> run(sender* self) {
+        while (!self->queue_.empty()) {
+            // Ein Fehler betrifft nur dieses Datagramm, UDP garantiert ohnehin keine Zustellung
+            boost::system::error_code ec;
+            co_await self->socket_.async_send_to(boost::asio::buffer(self->queue_.front()), self->target_,
+                boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            self->queue_.pop_front();
+
+            if (self->full_ && self->queue_.size() <= self->options_.capacity / 2) {
+                self->full_ = false;
+                if (self->ready_) {
+                    self->ready_();
+                }
+            }
+        }
+        self->sending_ = false;
+    }
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Simulierte Zeit einer Flotte. Sie beginnt bei start und läuft speed-mal so
+// schnell wie die echte Zeit, mit speed 1000 vergeht ein simulierter Tag also
+// in knapp eineinhalb Minuten. Skripte schlafen und Lastgänge laufen in dieser
+// Zeit, die Zeitstempel der Benachrichtigungen stammen ebenfalls daraus.
+//
+// Nach dem Anlegen wird die Uhr nur noch gelesen und kann deshalb von allen
+// Threads der Flotte gleichzeitig benutzt werden.
+class sim_clock {
+    std::chrono::system_clock::time_point start_;
+    std::chrono::steady_clock::time_point real_start_;
+    double speed_;
+
+public:
+    explicit sim_clock(double speed = 1.0, std::chrono::system_clock::time_point start = std::chrono::system_clock::now())
+        : start_(start)
+        , real_start_(std::chrono::steady_clock::now())
+        , speed_(speed) { }
+
+    double speed() const noexcept {
+        return speed_;
+    }
+
+    // Simulierte Zeit seit dem Start
+    std::chrono::milliseconds elapsed() const noexcept {
+        auto real = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - real_start_);
+        return std::chrono::milliseconds { static_cast<std::int64_t>(real.count() * speed_) };
+    }
+
+    // Zeitstempel in Millisekunden seit der Unix-Epoche zu einem simulierten Zeitpunkt
+    std::int64_t timestamp(std::chrono::milliseconds elapsed) const noexcept {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(start_.time_since_epoch()).count()
+            + elapsed.count();
+    }
+
+    std::int64_t timestamp() const noexcept {
+        return timestamp(elapsed());
+    }
+
+    // Echte Wartezeit für eine simulierte Dauer
+    std::chrono::steady_clock::duration real(std::chrono::milliseconds simulated) const noexcept {
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(static_cast<double>(simulated.count()) / speed_));
+    }
+
+    // Echter Zeitpunkt, zu dem seit dem Start simulated vergangen ist
+    std::chrono::steady_clock::time_point real_at(std::chrono::milliseconds simulated) const noexcept {
+        return real_start_ + real(simulated);
+    }
+};
@@ -0,0 +1,247 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr char magic[8] = { 'V', 'S', 'T', 'R', 'A', 'C', 'E', '1' };
+constexpr std::size_t header_size = sizeof(magic) + 2 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+
+// Die Werte werden ohne Umwandlung direkt aus der Datei gelesen
+static_assert(std::endian::native == std::endian::little, "Lastgänge setzen eine Little-Endian-Plattform voraus");
+
+template <typename T> T load(const char* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+template <typename T> void store(std::ofstream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Schließt die Datei, sobald die Abbildung steht oder etwas schiefgeht
+struct file_descriptor {
+    int fd;
+
+    ~file_descriptor() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+};
+
+std::vector<std::string_view> split(std::string_view line, char separator) {
+    std::vector<std::string_view> fields;
+    for (;;) {
+        auto pos = line.find(separator);
+        auto field = line.substr(0, pos);
+        while (!field.empty() && (field.front() == ' ' || field.front() == '"')) {
+            field.remove_prefix(1);
+        }
+        while (!field.empty() && (field.back() == ' ' || field.back() == '"' || field.back() == '\r')) {
+            field.remove_suffix(1);
+        }
+        fields.push_back(field);
+        if (pos == std::string_view::npos) {
+            return fields;
+        }
+        line.remove_prefix(pos + 1);
+    }
+}
+
+double parse_number(std::string_view field, std::size_t line) {
+    // std::from_chars für Gleitkommazahlen steht nicht überall zur Verfügung
+    std::string buf { field };
+    char* end = nullptr;
+    auto value = std::strtod(buf.c_str(), &end);
+    if (buf.empty() || end != buf.c_str() + buf.size() || !std::isfinite(value)) {
+        throw std::runtime_error { "Zeile " + std::to_string(line) + ": " + buf + " ist keine Zahl" };
+    }
+    return value;
+}
+} // namespace
+
+std::shared_ptr<const trace> trace::open(const std::string& path) {
+    file_descriptor file { ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+    struct stat info;
+    if (file.fd < 0 || ::fstat(file.fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        throw std::runtime_error { "Lastgang " + path + " konnte nicht geöffnet werden" };
+    }
+    auto size = static_cast<std::size_t>(info.st_size);
+    if (size < header_size) {
+        throw std::runtime_error { "Lastgang " + path + " ist zu kurz" };
+    }
+
+    auto* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, file.fd, 0);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error { "Lastgang " + path + " konnte nicht eingeblendet werden" };
+    }
+    std::shared_ptr<trace> result { new trace() };
+    result->data_ = data;
+    result->mapped_ = size;
+
+    const auto* p = static_cast<const char*>(data);
+    if (std::memcmp(p, magic, sizeof(magic)) != 0) {
+        throw std::runtime_error { "Lastgang " + path + " hat ein unbekanntes Format" };
+    }
+    p += sizeof(magic);
+    auto columns = load<std::uint32_t>(p);
+    auto interval = load<std::uint32_t>(p + sizeof(std::uint32_t));
+    auto samples = load<std::uint64_t>(p + 2 * sizeof(std::uint32_t));
+
+    // Erst mit der Anzahl der Spalten und Werte steht die erwartete Größe fest.
+    // Die Rechnung läuft in 128 Bit, damit ein kaputter Header nicht überläuft.
+    auto expected = static_cast<unsigned __int128>(header_size) + static_cast<unsigned __int128>(columns) * name_size
+        + static_cast<unsigned __int128>(columns) * samples * sizeof(float);
+    if (columns == 0 || samples == 0 || interval == 0 || expected != size) {
+        throw std::runtime_error { "Lastgang " + path + " ist beschädigt" };
+    }
+
+    result->columns_ = columns;
+    result->samples_ = static_cast<std::size_t>(samples);
+    result->interval_ = std::chrono::milliseconds { interval };
+    result->names_ = static_cast<const char*>(data) + header_size;
+    result->values_ = reinterpret_cast<const float*>(result->names_ + columns * name_size);
+
+    // Abgespielt wird von vorn nach hinten
+    ::madvise(data, size, MADV_SEQUENTIAL);
+    return result;
+}
+
+trace::~trace() noexcept {
+    if (data_) {
+        ::munmap(data_, mapped_);
+    }
+}
+
+std::string_view trace::name(std::size_t column) const noexcept {
+    const auto* name = names_ + column * name_size;
+    return { name, ::strnlen(name, name_size) };
+}
+
+std::optional<std::size_t> trace::find(std::string_view name) const noexcept {
+    if (name.empty()) {
+        return 0;
+    }
+    for (std::size_t i = 0; i < columns_; ++i) {
+        if (this->name(i) == name) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+double trace::at(std::size_t column, std::chrono::milliseconds t) const noexcept {
+    auto step = interval_.count();
+    auto position = t.count() % duration().count();
+    if (position < 0) {
+        position += duration().count();
+    }
+    auto index = static_cast<std::size_t>(position / step);
+    auto fraction = static_cast<double>(position % step) / static_cast<double>(step);
+
+    auto column_values = values(column);
+    double a = column_values[index];
+    double b = column_values[(index + 1) % samples_];
+    return a + (b - a) * fraction;
+}
+
+void convert_trace(const std::string& csv_path, const std::string& trace_path, std::chrono::milliseconds interval) {
+    std::ifstream input { csv_path };
+    if (!input) {
+        throw std::runtime_error { "CSV-Datei " + csv_path + " konnte nicht gelesen werden" };
+    }
+
+    std::string header;
+    if (!std::getline(input, header)) {
+        throw std::runtime_error { "CSV-Datei " + csv_path + " ist leer" };
+    }
+    char separator = header.find(';') != std::string::npos ? ';' : ',';
+    auto names = split(header, separator);
+    if (names.size() < 2) {
+        throw std::runtime_error { "CSV-Datei " + csv_path + " braucht eine Zeit- und mindestens eine Wertespalte" };
+    }
+    names.erase(names.begin());
+    for (auto name : names) {
+        if (name.empty() || name.size() > trace::name_size) {
+            throw std::runtime_error { "Spaltenname \"" + std::string { name } + "\" ist leer oder länger als "
+                + std::to_string(trace::name_size) + " Zeichen" };
+        }
+    }
+
+    // Die CSV-Datei wird zeilenweise gelesen, gehalten werden nur die Zahlen
+    std::vector<double> times;
+    std::vector<std::vector<double>> columns(names.size());
+    std::string line;
+    for (std::size_t number = 2; std::getline(input, line); ++number) {
+        if (line.empty() || line == "\r") {
+            continue;
+        }
+        auto fields = split(line, separator);
+        if (fields.size() != names.size() + 1) {
+            throw std::runtime_error { "Zeile " + std::to_string(number) + " hat " + std::to_string(fields.size())
+                + " statt " + std::to_string(names.size() + 1) + " Spalten" };
+        }
+        auto time = parse_number(fields[0], number);
+        if (!times.empty() && time <= times.back()) {
+            throw std::runtime_error { "Zeile " + std::to_string(number) + ": Die Zeit muss aufsteigend sein" };
+        }
+        times.push_back(time);
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            columns[i].push_back(parse_number(fields[i + 1], number));
+        }
+    }
+    if (times.size() < 2) {
+        throw std::runtime_error { "CSV-Datei " + csv_path + " braucht mindestens zwei Zeilen mit Werten" };
+    }
+
+    auto step = interval.count() > 0 ? static_cast<double>(interval.count()) / 1000.0 : times[1] - times[0];
+    auto step_ms = std::llround(step * 1000.0);
+    if (step_ms <= 0 || step_ms > UINT32_MAX) {
+        throw std::runtime_error { "Der Abstand der Werte muss zwischen 1 ms und 49 Tagen liegen" };
+    }
+    step = static_cast<double>(step_ms) / 1000.0;
+    auto samples = static_cast<std::uint64_t>(std::floor((times.back() - times.front()) / step)) + 1;
+
+    std::ofstream output { trace_path, std::ios::binary | std::ios::trunc };
+    if (!output) {
+        throw std::runtime_error { "Lastgang " + trace_path + " konnte nicht geschrieben werden" };
+    }
+    output.write(magic, sizeof(magic));
+    store(output, static_cast<std::uint32_t>(names.size()));
+    store(output, static_cast<std::uint32_t>(step_ms));
+    store(output, samples);
+    for (auto name : names) {
+        char buf[trace::name_size] = {};
+        std::memcpy(buf, name.data(), name.size());
+        output.write(buf, sizeof(buf));
+    }
+
+    for (const auto& column : columns) {
+        std::size_t row = 0;
+        for (std::uint64_t k = 0; k < samples; ++k) {
+            auto t = times.front() + static_cast<double>(k) * step;
+            while (row + 2 < times.size() && times[row + 1] <= t) {
+                ++row;
+            }
+            auto fraction = std::clamp((t - times[row]) / (times[row + 1] - times[row]), 0.0, 1.0);
+            store(output, static_cast<float>(column[row] + (column[row + 1] - column[row]) * fraction));
+        }
+    }
+
+    if (!output.flush()) {
+        throw std::runtime_error { "Lastgang " + trace_path + " konnte nicht geschrieben werden" };
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Ein aufgezeichneter Lastgang, der per mmap eingeblendet wird. Die Werte
+// werden nie kopiert, beliebig viele Prosumer können sich eine Datei über
+// einen std::shared_ptr teilen und lesen direkt aus dem Page-Cache.
+//
+// Dateiformat (alle Zahlen Little Endian):
+//
+//   char[8] Kennung "VSTRACE1"
+//   u32     Anzahl der Spalten
+//   u32     Abstand der Werte in Millisekunden
+//   u64     Anzahl der Werte pro Spalte
+//   Je Spalte 32 Bytes Name, mit Nullbytes aufgefüllt
+//   Je Spalte alle Werte als f32 hintereinander
+//
+// Die Werte liegen spaltenweise, damit ein Prosumer nur die Seiten seiner
+// eigenen Spalte in den Speicher holt. Ein Lastgang wird mit convert_trace()
+// aus einer CSV-Datei erzeugt.
+class trace {
+    void* data_ { nullptr };
+    std::size_t mapped_ { 0 };
+    std::size_t columns_ { 0 };
+    std::size_t samples_ { 0 };
+    std::chrono::milliseconds interval_ { 0 };
+    const char* names_ { nullptr };
+    const float* values_ { nullptr };
+
+    trace() = default;
+
+public:
+    static constexpr std::size_t name_size = 32;
+
+    // Blendet die Datei ein und prüft den Header. Fehler werden als
+    // std::runtime_error geworfen.
+    static std::shared_ptr<const trace> open(const std::string& path);
+
+    ~trace() noexcept;
+
+    trace(const trace&) = delete;
+    trace& operator=(const trace&) = delete;
+
+    std::size_t columns() const noexcept {
+        return columns_;
+    }
+
+    std::size_t samples() const noexcept {
+        return samples_;
+    }
+
+    std::chrono::milliseconds interval() const noexcept {
+        return interval_;
+    }
+
+    std::chrono::milliseconds duration() const noexcept {
+        return interval_ * static_cast<std::int64_t>(samples_);
+    }
+
+    std::string_view name(std::size_t column) const noexcept;
+
+    // Index der Spalte mit diesem Namen, ein leerer Name steht für die erste Spalte
+    std::optional<std::size_t> find(std::string_view name) const noexcept;
+
+    std::span<const float> values(std::size_t column) const noexcept {
+        return { values_ + column * samples_, samples_ };
+    }
+
+    // Wert der Spalte zum Zeitpunkt t nach dem ersten Wert, linear zwischen den
+    // beiden benachbarten Werten interpoliert. Nach dem letzten Wert beginnt
+    // der Lastgang wieder von vorn, auch negative Zeitpunkte werden so gefaltet.
+    double at(std::size_t column, std::chrono::milliseconds t) const noexcept;
+};
+
+// Wandelt eine CSV-Datei in einen Lastgang um. Die erste Zeile enthält die
+// Spaltennamen, die erste Spalte die Zeit in Sekunden (z.B. als Unix-Zeit),
+// alle weiteren Spalten Werte in Watt. Getrennt wird mit Komma oder Semikolon.
+// Die Zeilen werden linear auf einen festen Abstand von interval umgerechnet,
+// bei 0 gilt der Abstand der ersten beiden Zeilen. Fehler werden als
+// std::runtime_error geworfen.
+void convert_trace(const std::string& csv_path, const std::string& trace_path, std::chrono::milliseconds interval);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "models.h"
+
+// Typ eines Prosumers zu seinem Namen, z.B. "solar" oder "industrial"
+inline std::optional<decltype(core::notification::type)> parse_type_name(bool is_consumer, std::string_view name) {
+    if (is_consumer) {
+        static constexpr std::pair<std::string_view, core::consumer_type> consumer_types[] {
+            { "personal", core::consumer_type::personal },
+            { "industrial", core::consumer_type::industrial },
+        };
+        for (auto [n, type] : consumer_types) {
+            if (n == name) {
+                return type;
+            }
+        }
+    } else {
+        static constexpr std::pair<std::string_view, core::producer_type> producer_types[] {
+            { "coal", core::producer_type::coal },
+            { "nuclear", core::producer_type::nuclear },
+            { "solar", core::producer_type::solar },
+            { "water", core::producer_type::water },
+            { "wind", core::producer_type::wind },
+        };
+        for (auto [n, type] : producer_types) {
+            if (n == name) {
+                return type;
+            }
+        }
+    }
+    return std::nullopt;
+}